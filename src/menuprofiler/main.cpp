@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Fetches the exported menus of a running app the way the shell does, and reports
+// what every submenu costs: fetch latency, D-Bus messages and bytes, items and actions.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <gio/gio.h>
+
+namespace {
+
+struct CallStats
+{
+    qint64 nsecs = 0;
+    int messages = 0;
+    gsize bytes = 0;
+
+    CallStats &operator+=(const CallStats &other)
+    {
+        nsecs += other.nsecs;
+        messages += other.messages;
+        bytes += other.bytes;
+        return *this;
+    }
+};
+
+struct Submenu
+{
+    guint group;
+    QString label;
+    quint64 tag;
+    int depth;
+    int items;
+    CallStats stats;
+};
+
+class MenuProfiler
+{
+public:
+    MenuProfiler(GDBusConnection *connection, const QByteArray &service, const QByteArray &path)
+        : m_connection(connection)
+        , m_service(service)
+        , m_path(path)
+        , m_failed(false)
+    {}
+
+    void run(bool aboutToShow);
+    // Whether any call failed, the report is then incomplete
+    bool failed() const { return m_failed; }
+
+private:
+    GVariant *call(const QByteArray &path, const char *interface, const char *method,
+                   GVariant *parameters, CallStats &stats);
+    void fetchSubmenu(Submenu &submenu, QList<Submenu> &linkedSubmenus, bool aboutToShow);
+    int fetchActions(const QByteArray &path, CallStats &stats);
+
+    static gsize messageSize(GDBusMessage *message, GDBusCapabilityFlags capabilities);
+
+    GDBusConnection *m_connection;
+    QByteArray m_service;
+    QByteArray m_path;
+    bool m_failed;
+
+    QList<Submenu> m_submenus;
+    QSet<guint> m_groups;
+    // Action groups announced by the items of top level menus, besides the one on the menu path
+    QList<QPair<QByteArray, QByteArray>> m_actionGroups;
+};
+
+gsize MenuProfiler::messageSize(GDBusMessage *message, GDBusCapabilityFlags capabilities)
+{
+    gsize size = 0;
+    guchar *blob = g_dbus_message_to_blob(message, &size, capabilities, nullptr);
+    g_free(blob);
+    return blob ? size : 0;
+}
+
+// Call a method and wait for its reply, accounting for both messages.
+// Takes the floating reference of parameters. Returns the reply body, or null on error.
+GVariant *MenuProfiler::call(const QByteArray &path, const char *interface, const char *method,
+                             GVariant *parameters, CallStats &stats)
+{
+    GDBusMessage *message = g_dbus_message_new_method_call(m_service.constData(), path.constData(), interface, method);
+    g_dbus_message_set_body(message, parameters);
+    const GDBusCapabilityFlags capabilities = g_dbus_connection_get_capabilities(m_connection);
+
+    GError *error = nullptr;
+    QElapsedTimer timer;
+    timer.start();
+    GDBusMessage *reply = g_dbus_connection_send_message_with_reply_sync(m_connection, message, G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                                                         -1, nullptr, nullptr, &error);
+    stats.nsecs += timer.nsecsElapsed();
+    stats.messages++;
+    stats.bytes += messageSize(message, capabilities);
+    g_object_unref(message);
+
+    if (reply) {
+        stats.messages++;
+        stats.bytes += messageSize(reply, capabilities);
+        g_dbus_message_to_gerror(reply, &error);
+    }
+
+    GVariant *body = nullptr;
+    if (error) {
+        qWarning("%s.%s on %s failed - %s", interface, method, path.constData(), error->message);
+        g_error_free(error);
+        m_failed = true;
+    } else {
+        body = g_dbus_message_get_body(reply);
+        body = body ? g_variant_ref(body) : g_variant_ref_sink(g_variant_new("()"));
+    }
+    if (reply) {
+        g_object_unref(reply);
+    }
+    return body;
+}
+
+// Show and subscribe to the group of a submenu, collecting the submenus it links.
+void MenuProfiler::fetchSubmenu(Submenu &submenu, QList<Submenu> &linkedSubmenus, bool aboutToShow)
+{
+    if (aboutToShow && submenu.tag != 0) {
+        GVariant *reply = call(m_path, "qtunity.actions.extra", "aboutToShow",
+                               g_variant_new("(t)", submenu.tag), submenu.stats);
+        if (reply) g_variant_unref(reply);
+    }
+
+    const guint32 group = submenu.group;
+    GVariant *groups = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, &group, 1, sizeof(guint32));
+    GVariant *reply = call(m_path, "org.gtk.Menus", "Start", g_variant_new_tuple(&groups, 1), submenu.stats);
+    if (!reply) return;
+
+    GVariantIter *menus;
+    g_variant_get(reply, "(a(uuaa{sv}))", &menus);
+    guint32 menuGroup, menu;
+    GVariantIter *items;
+    while (g_variant_iter_next(menus, "(uuaa{sv})", &menuGroup, &menu, &items)) {
+        GVariant *item;
+        while ((item = g_variant_iter_next_value(items))) {
+            GVariantDict dict;
+            g_variant_dict_init(&dict, item);
+
+            guint32 linkGroup, linkMenu;
+            if (g_variant_dict_contains(&dict, ":section")) {
+                // Sections are in the same group
+            } else if (g_variant_dict_lookup(&dict, ":submenu", "(uu)", &linkGroup, &linkMenu)) {
+                submenu.items++;
+                if (!m_groups.contains(linkGroup)) {
+                    m_groups.insert(linkGroup);
+
+                    Submenu linked;
+                    linked.group = linkGroup;
+                    const gchar *label = nullptr;
+                    g_variant_dict_lookup(&dict, "label", "&s", &label);
+                    linked.label = QString::fromUtf8(label ? label : "");
+                    linked.tag = 0;
+                    g_variant_dict_lookup(&dict, "qtunity-tag", "t", &linked.tag);
+                    linked.depth = submenu.depth + 1;
+                    linked.items = 0;
+                    linkedSubmenus.append(linked);
+                }
+
+                const gchar *prefix = nullptr;
+                const gchar *actionsPath = nullptr;
+                if (g_variant_dict_lookup(&dict, "qtunity-actions", "(&s&o)", &prefix, &actionsPath)) {
+                    m_actionGroups.append(qMakePair(QByteArray(prefix), QByteArray(actionsPath)));
+                }
+            } else {
+                submenu.items++;
+            }
+
+            g_variant_dict_clear(&dict);
+            g_variant_unref(item);
+        }
+        g_variant_iter_free(items);
+    }
+    g_variant_iter_free(menus);
+    g_variant_unref(reply);
+}
+
+// Describe all the actions of an action group, returns their count.
+int MenuProfiler::fetchActions(const QByteArray &path, CallStats &stats)
+{
+    GVariant *reply = call(path, "org.gtk.Actions", "DescribeAll", nullptr, stats);
+    if (!reply) return 0;
+
+    GVariant *actions = g_variant_get_child_value(reply, 0);
+    const int count = static_cast<int>(g_variant_n_children(actions));
+    g_variant_unref(actions);
+    g_variant_unref(reply);
+    return count;
+}
+
+void MenuProfiler::run(bool aboutToShow)
+{
+    QTextStream out(stdout);
+    QElapsedTimer timer;
+    timer.start();
+
+    Submenu root;
+    root.group = 0;
+    root.label = QStringLiteral("(menubar)");
+    root.tag = 0;
+    root.depth = 0;
+    root.items = 0;
+    m_submenus.append(root);
+    m_groups.insert(0);
+
+    // The list grows while it is walked, breadth first like a shell opening every menu
+    for (int i = 0; i < m_submenus.count(); ++i) {
+        Submenu submenu = m_submenus.at(i);
+        QList<Submenu> linkedSubmenus;
+        fetchSubmenu(submenu, linkedSubmenus, aboutToShow);
+        m_submenus[i] = submenu;
+        m_submenus += linkedSubmenus;
+    }
+
+    CallStats total;
+    int items = 0;
+    out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+        .arg(QStringLiteral("submenu"), -40).arg(QStringLiteral("group"), 6).arg(QStringLiteral("items"), 6)
+        .arg(QStringLiteral("ms"), 9).arg(QStringLiteral("msgs"), 5).arg(QStringLiteral("bytes"), 9);
+    Q_FOREACH(const Submenu &submenu, m_submenus) {
+        const QString label = QString(submenu.depth * 2, QLatin1Char(' ')) + submenu.label;
+        out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+            .arg(label, -40).arg(submenu.group, 6).arg(submenu.items, 6)
+            .arg(submenu.stats.nsecs / 1000000.0, 9, 'f', 3).arg(submenu.stats.messages, 5)
+            .arg(static_cast<qulonglong>(submenu.stats.bytes), 9);
+        total += submenu.stats;
+        items += submenu.items;
+    }
+
+    int actions = 0;
+    QList<QPair<QByteArray, QByteArray>> actionGroups;
+    actionGroups.append(qMakePair(QByteArray("unity"), m_path));
+    actionGroups += m_actionGroups;
+    out << "\n";
+    for (const auto &actionGroup : actionGroups) {
+        CallStats stats;
+        const int count = fetchActions(actionGroup.second, stats);
+        out << QStringLiteral("%1 %2 %3 %4 %5\n")
+            .arg(QStringLiteral("actions %1 (%2)").arg(QString::fromUtf8(actionGroup.first), QString::fromUtf8(actionGroup.second)), -47)
+            .arg(count, 6).arg(stats.nsecs / 1000000.0, 9, 'f', 3).arg(stats.messages, 5)
+            .arg(static_cast<qulonglong>(stats.bytes), 9);
+        total += stats;
+        actions += count;
+    }
+
+    // Unsubscribe like the shell closing the menus
+    QVector<guint32> groups;
+    Q_FOREACH(const Submenu &submenu, m_submenus) {
+        groups.append(submenu.group);
+    }
+    GVariant *groupsValue = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, groups.constData(), groups.count(), sizeof(guint32));
+    GVariant *reply = call(m_path, "org.gtk.Menus", "End", g_variant_new_tuple(&groupsValue, 1), total);
+    if (reply) g_variant_unref(reply);
+
+    out << QStringLiteral("\n%1 submenus, %2 items, %3 actions, %4 messages, %5 bytes, %6 ms in calls, %7 ms total\n")
+        .arg(m_submenus.count()).arg(items).arg(actions).arg(total.messages)
+        .arg(static_cast<qulonglong>(total.bytes)).arg(total.nsecs / 1000000.0, 0, 'f', 3)
+        .arg(timer.nsecsElapsed() / 1000000.0, 0, 'f', 3);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("unity-menu-profiler"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Fetches all the exported menus of an app like the shell does, "
+                                                    "and reports the cost of every submenu."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("service"), QStringLiteral("Bus name of the app, e.g. :1.42"));
+    parser.addPositionalArgument(QStringLiteral("path"), QStringLiteral("Path of the menu, e.g. /io/unity8/Menu/0"));
+    QCommandLineOption addressOption(QStringLiteral("address"),
+                                     QStringLiteral("Connect to the bus at this address instead of the session bus."),
+                                     QStringLiteral("address"));
+    QCommandLineOption noAboutToShowOption(QStringLiteral("no-about-to-show"),
+                                           QStringLiteral("Don't call aboutToShow before fetching tagged submenus."));
+    parser.addOption(addressOption);
+    parser.addOption(noAboutToShowOption);
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.count() != 2) {
+        parser.showHelp(1);
+    }
+
+    GError *error = nullptr;
+    GDBusConnection *connection;
+    if (parser.isSet(addressOption)) {
+        connection = g_dbus_connection_new_for_address_sync(parser.value(addressOption).toUtf8().constData(),
+                                                            static_cast<GDBusConnectionFlags>(
+                                                                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                                G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+                                                            nullptr, nullptr, &error);
+    } else {
+        connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+    }
+    if (!connection) {
+        qWarning("Failed to connect - %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        return 1;
+    }
+
+    MenuProfiler profiler(connection, arguments.at(0).toUtf8(), arguments.at(1).toUtf8());
+    profiler.run(!parser.isSet(noAboutToShowOption));
+
+    g_object_unref(connection);
+    if (profiler.failed()) {
+        qWarning("Some calls failed, the report is incomplete");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+TARGET = unity-menu-profiler
+TEMPLATE = app
+
+QT = core
+
+CONFIG += console no_keywords link_pkgconfig
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++11 -Werror -Wall
+
+PKGCONFIG += gio-2.0
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays a menu trace recorded with QTUNITY_MENU_TRACE through the exporter, and reports
+// how long it takes. The menus are exported on the session bus while they are replayed,
+// so unity-menu-profiler can fetch them.
+
+#include "menutrace.h"
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+
+namespace {
+
+QAtomicInt s_mismatches;
+QtMessageHandler s_defaultHandler = nullptr;
+
+void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (type == QtWarningMsg && qstrcmp(context.category, "unityappmenu") == 0 &&
+            message.startsWith(QLatin1String("Exported menu"))) {
+        s_mismatches.ref();
+    }
+    s_defaultHandler(type, context, message);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Don't record the replay over the trace
+    qunsetenv("QTUNITY_MENU_TRACE");
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("unity-menu-replay"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a menu trace through the exporter and reports its duration."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("Trace recorded with QTUNITY_MENU_TRACE"));
+    QCommandLineOption realTimeOption(QStringLiteral("real-time"), QStringLiteral("Wait for the recorded time of every call."));
+    QCommandLineOption repeatOption(QStringLiteral("repeat"), QStringLiteral("Replay the trace this many times, 1 by default."),
+                                    QStringLiteral("count"), QStringLiteral("1"));
+    QCommandLineOption verifyOption(QStringLiteral("verify"),
+                                    QStringLiteral("Check the exported models after every update, fail on mismatches."));
+    parser.addOption(realTimeOption);
+    parser.addOption(repeatOption);
+    parser.addOption(verifyOption);
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.count() != 1) {
+        parser.showHelp(1);
+    }
+
+    // Read when the first exporter is created
+    if (parser.isSet(verifyOption)) {
+        qputenv("QTUNITY_MENU_VERIFY", "1");
+        s_defaultHandler = qInstallMessageHandler(messageHandler);
+    }
+
+    const int repeat = qMax(parser.value(repeatOption).toInt(), 1);
+    qint64 total = 0;
+    int records = 0;
+    for (int i = 0; i < repeat; ++i) {
+        UnityMenuTraceReplay replay;
+        if (!replay.load(arguments.at(0))) {
+            return 1;
+        }
+        records = replay.count();
+
+        QElapsedTimer timer;
+        timer.start();
+        replay.replay(parser.isSet(realTimeOption));
+        const qint64 elapsed = timer.elapsed();
+        total += elapsed;
+        qInfo("replayed %d records in %lld ms", records, elapsed);
+    }
+    if (repeat > 1) {
+        qInfo("%d replays of %d records in %lld ms, %.1f ms per replay", repeat, records, total,
+              static_cast<double>(total) / repeat);
+    }
+
+    if (s_mismatches.load() != 0) {
+        qWarning("%d exported models didn't match their platform menus", s_mismatches.load());
+        return 1;
+    }
+    return 0;
+}
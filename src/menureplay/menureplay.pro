@@ -0,0 +1,14 @@
+TARGET = unity-menu-replay
+TEMPLATE = app
+
+QT += gui
+
+CONFIG += console no_keywords
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++11 -Werror -Wall
+
+# Built in, the plugin hides UnityMenuTraceReplay
+include(../unityappmenu/unityappmenu.pri)
+
+SOURCES += main.cpp
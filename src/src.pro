@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
 
-SUBDIRS += unityappmenu
+SUBDIRS += unityappmenu menuprofiler menureplay
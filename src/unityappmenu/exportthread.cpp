@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exportthread.h"
+#include "logging.h"
+
+#include <QSemaphore>
+
+bool UnityMenuExportThread::isEnabled()
+{
+    static const bool enabled = [] {
+        const QByteArray exportThread = qgetenv("QTUNITY_MENU_EXPORT_THREAD");
+        return !exportThread.isEmpty() && exportThread.at(0) != '0';
+    }();
+    return enabled;
+}
+
+UnityMenuExportThread *UnityMenuExportThread::instance()
+{
+    static UnityMenuExportThread* thread = [] {
+        auto thread = new UnityMenuExportThread();
+        thread->start();
+        return thread;
+    }();
+    return thread;
+}
+
+UnityMenuExportThread::UnityMenuExportThread()
+    : m_context(g_main_context_new())
+    , m_dispatchPending(false)
+{
+    setObjectName(QStringLiteral("unityappmenu export"));
+}
+
+void UnityMenuExportThread::run()
+{
+    qCDebug(unityappmenu, "UnityMenuExportThread::run");
+
+    g_main_context_push_thread_default(m_context);
+    GMainLoop *loop = g_main_loop_new(m_context, FALSE);
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
+    g_main_context_pop_thread_default(m_context);
+}
+
+void UnityMenuExportThread::invoke(const std::function<void()> &call)
+{
+    if (QThread::currentThread() == this) {
+        call();
+        return;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_calls.enqueue(call);
+    if (!m_dispatchPending) {
+        // A single source drains the queue, which keeps the calls in order
+        m_dispatchPending = true;
+        GSource *source = g_idle_source_new();
+        g_source_set_callback(source, &UnityMenuExportThread::dispatchCalls, this, nullptr);
+        g_source_attach(source, m_context);
+        g_source_unref(source);
+    }
+}
+
+void UnityMenuExportThread::invokeSync(const std::function<void()> &call)
+{
+    if (QThread::currentThread() == this) {
+        call();
+        return;
+    }
+
+    QSemaphore done;
+    invoke([&call, &done]() {
+        call();
+        done.release();
+    });
+    done.acquire();
+}
+
+gboolean UnityMenuExportThread::dispatchCalls(gpointer data)
+{
+    auto thread = static_cast<UnityMenuExportThread*>(data);
+
+    QQueue<std::function<void()>> calls;
+    {
+        QMutexLocker lock(&thread->m_mutex);
+        calls.swap(thread->m_calls);
+        thread->m_dispatchPending = false;
+    }
+
+    while (!calls.isEmpty()) {
+        calls.dequeue()();
+    }
+    return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_EXPORTTHREAD_H
+#define UNITY_EXPORTTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QQueue>
+
+#include <gio/gio.h>
+
+#include <functional>
+
+// Thread running its own GMainContext, on which the exporters keep their gmenus and
+// action groups when QTUNITY_MENU_EXPORT_THREAD is set. The GDBus exports dispatch on
+// that context, so serializing menus for the shell no longer blocks the gui thread.
+class UnityMenuExportThread : public QThread
+{
+    Q_OBJECT
+public:
+    static bool isEnabled();
+    static UnityMenuExportThread *instance();
+
+    GMainContext *context() const { return m_context; }
+
+    // Run a call on the export thread, in the order of submission.
+    void invoke(const std::function<void()> &call);
+    // Same as invoke(), waiting for the call to be done.
+    void invokeSync(const std::function<void()> &call);
+
+protected:
+    void run() override;
+
+private:
+    UnityMenuExportThread();
+
+    static gboolean dispatchCalls(gpointer data);
+
+    GMainContext *m_context;
+    QMutex m_mutex;
+    QQueue<std::function<void()>> m_calls;
+    bool m_dispatchPending;
+};
+
+#endif // UNITY_EXPORTTHREAD_H
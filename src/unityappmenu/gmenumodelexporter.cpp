@@ -19,12 +19,32 @@
 #include "registry.h"
 #include "logging.h"
 #include "qtunityextraactionhandler.h"
-
+#include "sharedmenumodels.h"
+#include "exportthread.h"
+#include "mainloopbridge.h"
+#include "menulayoutbuffer.h"
+#include "menuactiongroup.h"
+#include "menusearchindex.h"
+#include "menutrace.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDebug>
+#include <QFile>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QTimerEvent>
+#include <QVariant>
+#include <QWindow>
 
+#include <climits>
 #include <functional>
 
+#include <gio/gunixfdlist.h>
+
+#include <unistd.h>
+
 namespace {
 
 // Derive an action name from the label by removing spaces and Capitilizing the words.
@@ -43,15 +63,433 @@ inline QString getActionString(QString label)
     return result;
 }
 
-static void activate_cb(GSimpleAction *action, GVariant *, gpointer user_data)
+static void activate_cb(const gchar *name, GVariant *parameter, gpointer user_data)
+{
+    qCDebug(unityappmenu, "Activate menu action '%s'", name);
+    auto exporter = static_cast<UnityGMenuModelExporter*>(user_data);
+    exporter->activateAction(QByteArray("unity.") + name, parameter);
+}
+
+static void activate_split_cb(const gchar *name, GVariant *parameter, gpointer user_data)
+{
+    auto splitGroup = static_cast<UnitySplitActionGroup*>(user_data);
+    qCDebug(unityappmenu, "Activate menu action '%s.%s'", splitGroup->prefix.constData(), name);
+    splitGroup->exporter->activateAction(splitGroup->prefix + '.' + name, parameter);
+}
+
+// Replace the items of a menu by the ones of another.
+static void replace_menu_items(GMenu *menu, GMenu *content)
+{
+    g_menu_remove_all(menu);
+    const int count = g_menu_model_get_n_items(G_MENU_MODEL(content));
+    for (int i = 0; i < count; ++i) {
+        GMenuItem *item = g_menu_item_new_from_model(G_MENU_MODEL(content), i);
+        g_menu_append_item(menu, item);
+        g_object_unref(item);
+    }
+}
+
+// Whether to check the exported models against the platform menus after every update
+static bool verifyExport()
+{
+    static const bool verify = [] {
+        const QByteArray verifyExport = qgetenv("QTUNITY_MENU_VERIFY");
+        return !verifyExport.isEmpty() && verifyExport.at(0) != '0';
+    }();
+    return verify;
+}
+
+// The value isn't consumed, callers keep their reference.
+static QString print_variant(GVariant *value)
+{
+    if (!value) return QStringLiteral("-");
+
+    gchar *text = g_variant_print(value, FALSE);
+    const QString result = QString::fromUtf8(text);
+    g_free(text);
+    return result;
+}
+
+// Counts the signals the exported models and action groups emit, on whichever thread they are
+// emitted. Each signal connection holds a reference, as the models may outlive their exporter.
+struct UnityModelSignalCounter
+{
+    QAtomicInt refs;
+    QAtomicInt count;
+    // Marks the models watched already
+    GQuark quark;
+};
+
+static UnityModelSignalCounter *signal_counter_ref(UnityModelSignalCounter *counter)
+{
+    counter->refs.ref();
+    return counter;
+}
+
+static void signal_counter_unref(gpointer data, GClosure *)
+{
+    auto counter = static_cast<UnityModelSignalCounter*>(data);
+    if (!counter->refs.deref()) {
+        delete counter;
+    }
+}
+
+static void count_signal_cb(UnityModelSignalCounter *counter)
+{
+    counter->count.ref();
+}
+
+static void watch_model_signals(GMenuModel *model, UnityModelSignalCounter *counter);
+
+static void watch_item_links(GMenuModel *model, int first, int count, UnityModelSignalCounter *counter)
+{
+    for (int i = first; i < first + count; ++i) {
+        GMenuLinkIter *iter = g_menu_model_iterate_item_links(model, i);
+        GMenuModel *link = nullptr;
+        while (g_menu_link_iter_get_next(iter, nullptr, &link)) {
+            watch_model_signals(link, counter);
+            g_object_unref(link);
+        }
+        g_object_unref(iter);
+    }
+}
+
+static void model_items_changed_cb(GMenuModel *model, gint position, gint, gint added, gpointer user_data)
+{
+    auto counter = static_cast<UnityModelSignalCounter*>(user_data);
+    counter->count.ref();
+    // The added items may link models which aren't watched yet
+    watch_item_links(model, position, added, counter);
+}
+
+// Count the items-changed signals of a model and of the models it links to, now and later on.
+static void watch_model_signals(GMenuModel *model, UnityModelSignalCounter *counter)
+{
+    if (g_object_get_qdata(G_OBJECT(model), counter->quark)) return;
+    g_object_set_qdata(G_OBJECT(model), counter->quark, counter);
+
+    g_signal_connect_data(model, "items-changed", G_CALLBACK(model_items_changed_cb),
+                          signal_counter_ref(counter), signal_counter_unref, GConnectFlags(0));
+    watch_item_links(model, 0, g_menu_model_get_n_items(model), counter);
+}
+
+static void watch_action_signals(GActionGroup *actionGroup, UnityModelSignalCounter *counter)
+{
+    const char *signals[] = { "action-added", "action-removed", "action-enabled-changed", "action-state-changed" };
+    for (const char *signal : signals) {
+        g_signal_connect_data(actionGroup, signal, G_CALLBACK(count_signal_cb),
+                              signal_counter_ref(counter), signal_counter_unref, G_CONNECT_SWAPPED);
+    }
+}
+
+// Describe an exported menu model in the format of UnityGMenuModelExporter::describeMenu().
+// actions holds the exported action groups by prefix.
+static QString describe_model(GMenuModel *model, const QHash<QByteArray, GActionGroup*> &actions, int indent)
+{
+    const QString prefix(indent, QLatin1Char(' '));
+    QStringList groups;
+    QString group;
+
+    const int count = g_menu_model_get_n_items(model);
+    for (int i = 0; i < count; ++i) {
+        GMenuModel *section = g_menu_model_get_item_link(model, i, G_MENU_LINK_SECTION);
+        if (section) {
+            if (!group.isEmpty()) groups << group;
+            group.clear();
+            const QString description = describe_model(section, actions, indent);
+            if (!description.isEmpty()) groups << description;
+            g_object_unref(section);
+            continue;
+        }
+
+        gchar *label = nullptr;
+        g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_LABEL, "s", &label);
+        group += prefix + QString::fromUtf8(label);
+        g_free(label);
+
+        GMenuModel *submenu = g_menu_model_get_item_link(model, i, G_MENU_LINK_SUBMENU);
+        if (submenu) {
+            gboolean enabled = TRUE;
+            g_menu_model_get_item_attribute(model, i, "submenu-enabled", "b", &enabled);
+            group += QStringLiteral(" submenu enabled=%1\n").arg(enabled ? 1 : 0);
+            group += describe_model(submenu, actions, indent + 2);
+            g_object_unref(submenu);
+            continue;
+        }
+
+        gchar *action = nullptr;
+        g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_ACTION, "s", &action);
+        const QByteArray actionName(action ? action : "");
+        g_free(action);
+
+        gboolean enabled = FALSE;
+        GVariant *state = nullptr;
+        const int dot = actionName.indexOf('.');
+        GActionGroup *actionGroup = dot > 0 ? actions.value(actionName.left(dot), nullptr) : nullptr;
+        const bool exists = actionGroup &&
+            g_action_group_query_action(actionGroup, actionName.constData() + dot + 1, &enabled, nullptr, nullptr, nullptr, &state);
+        GVariant *target = g_menu_model_get_item_attribute_value(model, i, G_MENU_ATTRIBUTE_TARGET, nullptr);
+        group += QStringLiteral(" action=%1 target=%2 enabled=%3 state=%4\n")
+            .arg(QString::fromUtf8(actionName))
+            .arg(print_variant(target))
+            .arg(exists ? QString::number(enabled ? 1 : 0) : QStringLiteral("missing"))
+            .arg(print_variant(state));
+        if (target) {
+            g_variant_unref(target);
+        }
+        if (state) {
+            g_variant_unref(state);
+        }
+    }
+    if (!group.isEmpty()) groups << group;
+
+    return groups.join(prefix + QStringLiteral("--\n"));
+}
+
+// Describe an exported menu model the way a shell shows it: one line per item, submenus
+// indented below their item, and "--" lines where non-empty sections meet.
+static QString describe_model_layout(GMenuModel *model, int indent)
+{
+    const QString prefix(indent, QLatin1Char(' '));
+    QStringList groups;
+    QString group;
+
+    const int count = g_menu_model_get_n_items(model);
+    for (int i = 0; i < count; ++i) {
+        GMenuModel *section = g_menu_model_get_item_link(model, i, G_MENU_LINK_SECTION);
+        if (section) {
+            if (!group.isEmpty()) groups << group;
+            group.clear();
+            const QString description = describe_model_layout(section, indent);
+            if (!description.isEmpty()) groups << description;
+            g_object_unref(section);
+            continue;
+        }
+
+        gchar *label = nullptr;
+        g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_LABEL, "s", &label);
+        group += prefix + QString::fromUtf8(label);
+        g_free(label);
+
+        GMenuModel *submenu = g_menu_model_get_item_link(model, i, G_MENU_LINK_SUBMENU);
+        if (submenu) {
+            group += QStringLiteral(" submenu\n") + describe_model_layout(submenu, indent + 2);
+            g_object_unref(submenu);
+        } else {
+            group += QLatin1Char('\n');
+        }
+    }
+    if (!group.isEmpty()) groups << group;
+
+    return groups.join(prefix + QStringLiteral("--\n"));
+}
+
+// Describe a full depth aa{sv} layout in the format of describe_model_layout(), with a "--"
+// line for each of its separators.
+static QString describe_layout(GVariant *items, int indent)
+{
+    const QString prefix(indent, QLatin1Char(' '));
+    QString description;
+
+    GVariantIter iter;
+    GVariant *item;
+    g_variant_iter_init(&iter, items);
+    while ((item = g_variant_iter_next_value(&iter))) {
+        gboolean separator = FALSE;
+        if (g_variant_lookup(item, "separator", "b", &separator) && separator) {
+            description += prefix + QStringLiteral("--\n");
+            g_variant_unref(item);
+            continue;
+        }
+
+        const gchar *label = "";
+        g_variant_lookup(item, "label", "&s", &label);
+        description += prefix + QString::fromUtf8(label);
+
+        GVariant *submenu = g_variant_lookup_value(item, "submenu", G_VARIANT_TYPE("aa{sv}"));
+        if (submenu) {
+            description += QStringLiteral(" submenu\n") + describe_layout(submenu, indent + 2);
+            g_variant_unref(submenu);
+        } else {
+            description += QLatin1Char('\n');
+        }
+        g_variant_unref(item);
+    }
+    return description;
+}
+
+// Posted to an exporter to run a call on the gui thread. The call takes over the invocation
+// it answers, if any, which gets an error if the exporter goes away before the call is run.
+class UnityGuiCallEvent : public QEvent
 {
-    qCDebug(unityappmenu, "Activate menu action '%s'", g_action_get_name(G_ACTION(action)));
-    auto item = static_cast<UnityPlatformMenuItem*>(user_data);
-    item->activated();
+public:
+    static const QEvent::Type eventType;
+
+    UnityGuiCallEvent(const std::function<void()> &call, GDBusMethodInvocation *invocation)
+        : QEvent(eventType)
+        , call(call)
+        , invocation(invocation)
+    {}
+
+    ~UnityGuiCallEvent()
+    {
+        if (invocation) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                                  "The menu was removed");
+        }
+    }
+
+    std::function<void()> call;
+    GDBusMethodInvocation *invocation;
+};
+
+const QEvent::Type UnityGuiCallEvent::eventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+// Split the items of a menu from first to last at its separators, the way they are exported:
+// the first range holds the items before the first separator, which go inline, the others
+// are the sections after each separator. Sections without visible items are dropped, unless
+// the menu wants all its separators, and so is an empty last section.
+// Shared by the gmenus and the layouts, so both show the same separators.
+static QVector<QPair<int, int>> split_sections(int first, int last, bool collapsible,
+                                               const std::function<bool(int)> &isSeparator,
+                                               const std::function<bool(int)> &isVisible)
+{
+    QVector<QPair<int, int>> sections;
+    int sectionStart = first;
+    bool sectionVisible = false;
+    for (int i = first; i < last; ++i) {
+        if (!isSeparator(i)) {
+            sectionVisible = sectionVisible || isVisible(i);
+            continue;
+        }
+        if (sections.isEmpty() || sectionVisible || !collapsible) {
+            sections.append(qMakePair(sectionStart, i));
+        }
+        sectionStart = i + 1;
+        sectionVisible = false;
+    }
+    if (sections.isEmpty() || (sectionStart != last && (sectionVisible || !collapsible))) {
+        sections.append(qMakePair(sectionStart, last));
+    }
+    return sections;
+}
+
+// Build the gmenu of a captured platform menu and of its submenus, the way addMenuPage() does.
+// Only uses the snapshot, so it can run on any thread.
+void build_snapshot(UnityMenuSnapshot &snapshot)
+{
+    if (snapshot.model) return;
+    snapshot.model = g_menu_new();
+
+    auto appendItem = [&snapshot](UnityMenuSnapshotItem &item, GMenu *menu) {
+        if (!item.visible) return;
+
+        const QByteArray label(item.text.toUtf8());
+        GMenuItem *gmenuItem;
+        if (item.submenu) {
+            build_snapshot(*item.snapshot);
+            gmenuItem = g_menu_item_new_submenu(label.constData(), G_MENU_MODEL(item.snapshot->model));
+            if (item.tag != 0) {
+                g_menu_item_set_attribute_value(gmenuItem, "qtunity-tag", g_variant_new_uint64(item.tag));
+            }
+            g_menu_item_set_attribute_value(gmenuItem, "submenu-enabled", g_variant_new_boolean(item.enabled));
+        } else {
+            const QByteArray actionLabel(getActionString(item.text).toUtf8());
+            gmenuItem = g_menu_item_new(label.constData(), nullptr);
+            g_menu_item_set_attribute(gmenuItem, "accel", "s", item.accel.constData());
+            if (!item.radioGroup.isEmpty()) {
+                item.action = actionLabel;
+                g_menu_item_set_action_and_target_value(gmenuItem, item.radioGroup.constData(),
+                                                        g_variant_new_string(actionLabel.constData()));
+            } else {
+                item.action = snapshot.prefix + '.' + actionLabel;
+                g_menu_item_set_detailed_action(gmenuItem, item.action.constData());
+            }
+        }
+        g_menu_append_item(menu, gmenuItem);
+        g_object_unref(gmenuItem);
+    };
+
+    auto appendSection = [&snapshot, &appendItem](int first, int last) {
+        GMenu *section = g_menu_new();
+        for (int i = first; i < last; ++i) {
+            appendItem(snapshot.items[i], section);
+        }
+        GMenuItem *sectionItem = g_menu_item_new_section("", G_MENU_MODEL(section));
+        g_menu_append_item(snapshot.model, sectionItem);
+        g_object_unref(sectionItem);
+        g_object_unref(section);
+    };
+
+    const QVector<QPair<int, int>> sections = split_sections(0, snapshot.items.count(), snapshot.collapsible,
+        [&snapshot](int i) { return snapshot.items.at(i).separator; },
+        [&snapshot](int i) { return snapshot.items.at(i).visible; });
+    for (int i = sections.first().first; i < sections.first().second; ++i) {
+        appendItem(snapshot.items[i], snapshot.model);
+    }
+    for (int i = 1; i < sections.count(); ++i) {
+        appendSection(sections.at(i).first, sections.at(i).second);
+    }
 }
 
+class UnitySnapshotBuilder : public QRunnable
+{
+public:
+    UnitySnapshotBuilder(UnityMenuSnapshot *snapshot)
+        : m_snapshot(snapshot)
+    {}
+
+    void run() override { build_snapshot(*m_snapshot); }
+
+private:
+    UnityMenuSnapshot *m_snapshot;
+};
+
+// Kept apart from the global pool of the app
+Q_GLOBAL_STATIC(QThreadPool, s_buildPool)
+
 static uint s_menuId = 0;
 
+// Continuation submenus created, for their tags
+static quint64 s_pageCount = 0;
+
+// Number of items exported at once for a paged menu, 0 for menus exported in one go.
+// Opt-in per menu with the _unity_menu_page_size property of the platform menu,
+// or for all menus with QTUNITY_MENU_PAGE_SIZE.
+static int pageSize(UnityPlatformMenu *gplatformMenu)
+{
+    static const int defaultPageSize = qMax(qgetenv("QTUNITY_MENU_PAGE_SIZE").toInt(), 0);
+    const QVariant size = gplatformMenu->property("_unity_menu_page_size");
+    return size.isValid() ? qMax(size.toInt(), 0) : defaultPageSize;
+}
+
+static bool isPaged(UnityPlatformMenu *gplatformMenu)
+{
+    const int size = pageSize(gplatformMenu);
+    return size > 0 && gplatformMenu->menuItems().count() > size;
+}
+
+// Exporters alive in the process
+static int s_exporterCount = 0;
+
+// Resident set size of the process, in kB.
+static qint64 residentSetSize()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) return 0;
+
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2) return 0;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+// Number of changes kept for getChangesSince
+static const int s_journalLength = 256;
+
+// Submenus shown this recently stay built when the window goes to the background, the user
+// often comes right back to it.
+static const qint64 s_backgroundColdness = 30 * 1000;
+
 #define MENU_OBJECT_PATH "/io/unity8/Menu/%1"
 
 } // namespace
@@ -59,51 +497,203 @@ static uint s_menuId = 0;
 
 UnityMenuBarExporter::UnityMenuBarExporter(UnityPlatformMenuBar * bar)
     : UnityGMenuModelExporter(bar)
+    , m_bar(bar)
+    , m_prewarmSource(0)
 {
     qCDebug(unityappmenu, "UnityMenuBarExporter::UnityMenuBarExporter");
 
     connect(bar, &UnityPlatformMenuBar::structureChanged, this, [this]() {
+        m_mutationCount++;
         m_structureTimer.start();
     });
     connect(&m_structureTimer, &QTimer::timeout, this, [this, bar]() {
+        // Keep the previous submenus linked until the new tree is built so unchanged
+        // ones can be shared again instead of being rebuilt.
+        const QList<GMenu*> previousMenus = takeSubmenuModels();
         clear();
+        m_topLevelMenus.clear();
+
+        QList<UnityPlatformMenu*> menus;
+        Q_FOREACH(QPlatformMenu *platformMenu, bar->menus()) {
+            UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+            if (gplatformMenu && splitActionGroups()) {
+                addActionGroup(gplatformMenu);
+            }
+            menus.append(gplatformMenu);
+        }
+        buildSubmenusInParallel(menus);
+
+        GMenu *content = g_menu_new();
         Q_FOREACH(QPlatformMenu *platformMenu, bar->menus()) {
-            GMenuItem* item = createSubmenu(platformMenu, nullptr);
+            UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+            GMenuItem* item = createSubmenu(platformMenu, nullptr, actionPrefix(gplatformMenu));
             if (item) {
-                g_menu_append_item(m_gmainMenu, item);
+                g_menu_append_item(content, item);
                 g_object_unref(item);
+                m_topLevelMenus.append(gplatformMenu);
             }
 
-            UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
             if (gplatformMenu) {
                 // Sadly we don't have a better way to propagate a enabled change in a top level menu
                 // than reseting the whole menubar
-                connect(gplatformMenu, &UnityPlatformMenu::enabledChanged, bar, &UnityPlatformMenuBar::structureChanged);
+                connect(gplatformMenu, &UnityPlatformMenu::enabledChanged, bar, &UnityPlatformMenuBar::structureChanged,
+                        Qt::UniqueConnection);
             }
         }
+        setMenuItems(m_gmainMenu, content);
+        g_object_unref(content);
+        releaseSubmenuModels(previousMenus);
+        recordChange(0, QByteArray());
+    });
+
+    // Export speculatively once there is something to export, so that showing the
+    // window only has to register the menu.
+    connect(bar, &UnityPlatformMenuBar::menuInserted, this, [this](QPlatformMenu *platformMenu) {
+        UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+        if (gplatformMenu) {
+            disconnect(gplatformMenu, &UnityPlatformMenu::visibleChanged, this, 0);
+            connect(gplatformMenu, &UnityPlatformMenu::visibleChanged, this, [this, gplatformMenu]() {
+                updateMenuVisibility(gplatformMenu);
+            });
+        }
+
+        if (m_exportedModel == 0 && m_prewarmSource == 0) {
+            // Below the priority of the Qt sources, so it only runs once the event loop is
+            // idle, after the model was built. Without the glib event dispatcher the bridge
+            // iterates the default context.
+            UnityMainLoopBridge::ensure();
+            m_prewarmSource = g_idle_add_full(G_PRIORITY_LOW, prewarm, this, nullptr);
+        }
+    });
+    connect(bar, &UnityPlatformMenuBar::menuRemoved, this, [this](QPlatformMenu *platformMenu) {
+        UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+        if (gplatformMenu) {
+            disconnect(gplatformMenu, &UnityPlatformMenu::visibleChanged, this, 0);
+            removeActionGroup(gplatformMenu);
+        }
     });
 
     connect(bar, &UnityPlatformMenuBar::ready, this, [this]() {
-        exportModels();
+        exportMenuBar();
     });
 }
 
 UnityMenuBarExporter::~UnityMenuBarExporter()
 {
     qCDebug(unityappmenu, "UnityMenuBarExporter::~UnityMenuBarExporter");
+    if (m_prewarmSource != 0) {
+        g_source_remove(m_prewarmSource);
+    }
+}
+
+gboolean UnityMenuBarExporter::prewarm(gpointer user_data)
+{
+    auto exporter = static_cast<UnityMenuBarExporter*>(user_data);
+    exporter->m_prewarmSource = 0;
+    exporter->exportMenuBar();
+    return G_SOURCE_REMOVE;
+}
+
+void UnityMenuBarExporter::exportMenuBar()
+{
+    if (m_prewarmSource != 0) {
+        g_source_remove(m_prewarmSource);
+        m_prewarmSource = 0;
+    }
+    exportModels();
+
+    static bool firstExport = true;
+    if (firstExport && m_exportedModel != 0) {
+        firstExport = false;
+        qCDebug(unityappmenuTiming, "First menubar exported %lld ms after startup", unityappmenuStartupTimer().elapsed());
+    }
+}
+
+// Insert or remove the item of a top level menu which was shown or hidden,
+// instead of rebuilding the whole menubar.
+void UnityMenuBarExporter::updateMenuVisibility(UnityPlatformMenu *gplatformMenu)
+{
+    m_mutationCount++;
+    // A pending rebuild takes care of it
+    if (m_structureTimer.isActive() || !m_bar->menus().contains(gplatformMenu)) return;
+
+    const int index = m_topLevelMenus.indexOf(gplatformMenu);
+    const bool visible = isSubmenuVisible(gplatformMenu, nullptr);
+    if (visible == (index != -1)) return;
+
+    if (visible) {
+        int position = 0;
+        Q_FOREACH(QPlatformMenu *platformMenu, m_bar->menus()) {
+            if (platformMenu == gplatformMenu) break;
+            if (m_topLevelMenus.contains(static_cast<UnityPlatformMenu*>(platformMenu))) position++;
+        }
+
+        if (splitActionGroups()) {
+            addActionGroup(gplatformMenu);
+        }
+        GMenuItem* item = createSubmenu(gplatformMenu, nullptr, actionPrefix(gplatformMenu));
+        insertMenuItem(m_gmainMenu, position, item);
+        g_object_unref(item);
+        m_topLevelMenus.insert(position, gplatformMenu);
+    } else {
+        removeMenuItem(m_gmainMenu, index);
+        m_topLevelMenus.removeAt(index);
+        releaseSubtree(gplatformMenu);
+    }
+    recordChange(0, QByteArray());
+}
+
+// The position in the menubar, hidden menus included, so showing a menu doesn't move the others
+int UnityMenuBarExporter::topLevelIndex(UnityPlatformMenu *gplatformMenu) const
+{
+    return m_bar->menus().indexOf(gplatformMenu);
+}
+
+QString UnityMenuBarExporter::describeRoot()
+{
+    QString description;
+    Q_FOREACH(QPlatformMenu *platformMenu, m_bar->menus()) {
+        UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+        if (!gplatformMenu || !isSubmenuVisible(gplatformMenu, nullptr)) continue;
+
+        description += describeSubmenu(gplatformMenu, nullptr, 0);
+    }
+    return description;
+}
+
+GVariant *UnityMenuBarExporter::rootLayout(int depth)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    Q_FOREACH(QPlatformMenu *platformMenu, m_bar->menus()) {
+        UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+        if (!gplatformMenu || !isSubmenuVisible(gplatformMenu, nullptr)) continue;
+
+        g_variant_builder_add_value(&builder, submenuLayout(gplatformMenu, nullptr, depth));
+    }
+    return g_variant_builder_end(&builder);
 }
 
 UnityMenuExporter::UnityMenuExporter(UnityPlatformMenu *menu)
     : UnityGMenuModelExporter(menu)
+    , m_menu(menu)
 {
     qCDebug(unityappmenu, "UnityMenuExporter::UnityMenuExporter");
 
     connect(menu, &UnityPlatformMenu::structureChanged, this, [this]() {
+        m_mutationCount++;
         m_structureTimer.start();
     });
     connect(&m_structureTimer, &QTimer::timeout, this, [this, menu]() {
+        const QList<GMenu*> previousMenus = takeSubmenuModels();
         clear();
-        addSubmenuItems(menu, m_gmainMenu);
+        GMenu *content = g_menu_new();
+        addSubmenuItems(menu, content);
+        moveMenuItemsState(content, m_gmainMenu);
+        setMenuItems(m_gmainMenu, content);
+        g_object_unref(content);
+        releaseSubmenuModels(previousMenus);
+        recordChange(0, QByteArray());
     });
     addSubmenuItems(menu, m_gmainMenu);
 }
@@ -113,27 +703,94 @@ UnityMenuExporter::~UnityMenuExporter()
     qCDebug(unityappmenu, "UnityMenuExporter::~UnityMenuExporter");
 }
 
+QString UnityMenuExporter::describeRoot()
+{
+    return describeMenu(m_menu, 0);
+}
+
+GVariant *UnityMenuExporter::rootLayout(int depth)
+{
+    return menuLayout(m_menu, depth);
+}
+
 UnityGMenuModelExporter::UnityGMenuModelExporter(QObject *parent)
     : QObject(parent)
     , m_connection(nullptr)
     , m_gmainMenu(g_menu_new())
-    , m_gactionGroup(g_simple_action_group_new())
+    , m_gactionGroup(unity_menu_action_group_new())
     , m_exportedModel(0)
     , m_exportedActions(0)
     , m_qtunityExtraHandler(nullptr)
     , m_menuPath(QStringLiteral(MENU_OBJECT_PATH).arg(s_menuId++))
+    , m_threaded(UnityMenuExportThread::isEnabled())
+    , m_guiCallTarget(new UnityGuiCallTarget)
+    , m_revision(0)
+    , m_journalStart(0)
+    , m_mutationCount(0)
+    , m_modelSignals(nullptr)
+    , m_reusedSubmenuCount(0)
+    , m_actionGroupCount(0)
 {
     m_structureTimer.setSingleShot(true);
     m_structureTimer.setInterval(0);
+
+    m_actionUpdateTimer.setSingleShot(true);
+    m_actionUpdateTimer.setInterval(0);
+    connect(&m_actionUpdateTimer, &QTimer::timeout, this, &UnityGMenuModelExporter::flushActionUpdates);
+
+    m_verifyTimer.setSingleShot(true);
+    m_verifyTimer.setInterval(0);
+    connect(&m_verifyTimer, &QTimer::timeout, this, &UnityGMenuModelExporter::verifyModels);
+    m_statisticsTimer.start();
+    if (verifyExport()) {
+        static QAtomicInt counterId;
+        m_modelSignals = new UnityModelSignalCounter;
+        m_modelSignals->refs.store(1);
+        m_modelSignals->quark = g_quark_from_string(QByteArray("unity-model-signals-") +
+                                                    QByteArray::number(counterId.fetchAndAddRelaxed(1)));
+        watch_model_signals(G_MENU_MODEL(m_gmainMenu), m_modelSignals);
+        watch_action_signals(G_ACTION_GROUP(m_gactionGroup), m_modelSignals);
+    }
+
+    m_evictionClock.start();
+    if (evictAfter() > 0) {
+        m_evictionTimer.setInterval(evictAfter());
+        connect(&m_evictionTimer, &QTimer::timeout, this, [this]() {
+            evictColdSubmenus(evictAfter());
+        });
+        m_evictionTimer.start();
+    }
+
+    m_guiCallTarget->exporter = this;
+    unity_menu_action_group_set_activate_func(m_gactionGroup, activate_cb, this);
+    s_exporterCount++;
 }
 
 UnityGMenuModelExporter::~UnityGMenuModelExporter()
 {
+    // Calls posted from now on are dropped, the pending ones along with us
+    {
+        QMutexLocker lock(&m_guiCallTarget->mutex);
+        m_guiCallTarget->exporter = nullptr;
+    }
     unexportModels();
     clear();
+    Q_FOREACH(UnityPlatformMenu *gplatformMenu, m_actionPrefixes.keys()) {
+        removeActionGroup(gplatformMenu);
+    }
+
+    // Closures still queued on the export thread may outlive us
+    UnityMenuActionGroup *actionGroup = m_gactionGroup;
+    runInExportContext([actionGroup]() {
+        unity_menu_action_group_set_activate_func(actionGroup, nullptr, nullptr);
+    });
 
     g_object_unref(m_gmainMenu);
     g_object_unref(m_gactionGroup);
+    if (m_modelSignals) {
+        signal_counter_unref(m_modelSignals, nullptr);
+    }
+    s_exporterCount--;
 }
 
 // Clear the menu and actions that have been created.
@@ -146,236 +803,1680 @@ void UnityGMenuModelExporter::clear()
     }
     m_propertyConnections.clear();
 
-    g_menu_remove_all(m_gmainMenu);
-
     Q_FOREACH(const QSet<QByteArray>& menuActions, m_actions) {
         Q_FOREACH(const QByteArray& action, menuActions) {
-            g_action_map_remove_action(G_ACTION_MAP(m_gactionGroup), action.constData());
+            removeAction(action);
         }
     }
     m_actions.clear();
+    m_menuActions.clear();
+    m_searchIndex.clear();
+    m_radioGroups.clear();
+    m_pendingActionUpdates.clear();
+
+    releaseSubmenuModels(takeSubmenuModels());
+    m_parentMenus.clear();
+    m_subtreeHashes.clear();
+    m_submenusWithTag.clear();
+    m_evictedMenus.clear();
+    dropMenuPages(nullptr);
+
+    // The menus still exported are watched again when they are rebuilt
+    Q_FOREACH(UnityPlatformMenu *gplatformMenu, m_watchedMenus) {
+        unwatchSubmenu(gplatformMenu);
+    }
+}
 
-    m_gmenusForMenus.clear();
+// Replace the items of an exported menu with the ones of a menu built on the side.
+// With the export thread, this is the only way the gui thread modifies exported menus.
+void UnityGMenuModelExporter::setMenuItems(GMenu *menu, GMenu *content)
+{
+    g_object_ref(menu);
+    g_object_ref(content);
+    runInExportContext([menu, content]() {
+        replace_menu_items(menu, content);
+        g_object_unref(content);
+        g_object_unref(menu);
+    });
 }
 
-void UnityGMenuModelExporter::timerEvent(QTimerEvent *e)
+// Insert an item in an exported menu.
+void UnityGMenuModelExporter::insertMenuItem(GMenu *menu, int position, GMenuItem *item)
 {
-    // Find the menu, it's a very short list
-    auto it = m_reloadMenuTimers.begin();
-    for (; it != m_reloadMenuTimers.end(); ++it) {
-        if (e->timerId() == it.value())
-            break;
-    }
+    g_object_ref(menu);
+    g_object_ref(item);
+    runInExportContext([menu, position, item]() {
+        g_menu_insert_item(menu, position, item);
+        g_object_unref(item);
+        g_object_unref(menu);
+    });
+}
 
-    if (it != m_reloadMenuTimers.end()) {
-        UnityPlatformMenu* gplatformMenu = it.key();
-        GMenu *menu = m_gmenusForMenus.value(gplatformMenu);
-        if (menu) {
-            Q_FOREACH(const QMetaObject::Connection& connection, m_propertyConnections[menu]) {
-                QObject::disconnect(connection);
-            }
-            m_propertyConnections.remove(menu);
-            Q_FOREACH(const QByteArray& action, m_actions[menu]) {
-                g_action_map_remove_action(G_ACTION_MAP(m_gactionGroup), action.constData());
-            }
-            m_actions.remove(menu);
-            g_menu_remove_all(menu);
-            addSubmenuItems(gplatformMenu, menu);
-        } else {
-            qWarning() << "Got an update timer for a menu that has no GMenu" << gplatformMenu;
-        }
+// Remove an item from an exported menu.
+void UnityGMenuModelExporter::removeMenuItem(GMenu *menu, int position)
+{
+    g_object_ref(menu);
+    runInExportContext([menu, position]() {
+        g_menu_remove(menu, position);
+        g_object_unref(menu);
+    });
+}
 
-        m_reloadMenuTimers.erase(it);
+// Move the actions and connections created for the items of a menu to another menu.
+void UnityGMenuModelExporter::moveMenuItemsState(GMenu *from, GMenu *to)
+{
+    if (m_actions.contains(from)) {
+        m_actions[to].unite(m_actions.take(from));
+    }
+    if (m_propertyConnections.contains(from)) {
+        m_propertyConnections[to] += m_propertyConnections.take(from);
+    }
+}
+
+// Run a call modifying the exported menus or actions, on the export thread if there is one.
+void UnityGMenuModelExporter::runInExportContext(const std::function<void()> &call)
+{
+    if (m_threaded) {
+        UnityMenuExportThread::instance()->invoke(call);
     } else {
-        qWarning() << "Got an update timer for a timer that was not running";
+        call();
     }
-    killTimer(e->timerId());
 }
 
-// Export the model on dbus
-void UnityGMenuModelExporter::exportModels()
+// Run a call on the gui thread, from the export thread or the gui thread itself.
+// If the call answers an invocation, it gets an error when the exporter is gone before.
+void UnityGMenuModelExporter::runInGuiThread(const std::function<void()> &call, GDBusMethodInvocation *invocation)
 {
-    GError *error = nullptr;
-    m_connection = g_bus_get_sync (G_BUS_TYPE_SESSION, nullptr, &error);
-    if (!m_connection) {
-        qCWarning(unityappmenu, "Failed to retreive session bus - %s", error ? error->message : "unknown error");
-        g_error_free (error);
+    if (QThread::currentThread() == thread()) {
+        call();
         return;
     }
 
-    QByteArray menuPath(m_menuPath.toUtf8());
-
-    if (m_exportedModel == 0) {
-        m_exportedModel = g_dbus_connection_export_menu_model(m_connection, menuPath.constData(), G_MENU_MODEL(m_gmainMenu), &error);
-        if (m_exportedModel == 0) {
-            qCWarning(unityappmenu, "Failed to export menu - %s", error ? error->message : "unknown error");
-            g_error_free (error);
-            error = nullptr;
-        } else {
-            qCDebug(unityappmenu, "Exported menu on %s", g_dbus_connection_get_unique_name(m_connection));
-        }
+    const QSharedPointer<UnityGuiCallTarget> target = m_guiCallTarget;
+    QMutexLocker lock(&target->mutex);
+    if (target->exporter) {
+        QCoreApplication::postEvent(target->exporter, new UnityGuiCallEvent(call, invocation));
+    } else if (invocation) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                              "The menu was removed");
     }
+}
 
-    if (m_exportedActions == 0) {
-        m_exportedActions = g_dbus_connection_export_action_group(m_connection, menuPath.constData(), G_ACTION_GROUP(m_gactionGroup), &error);
-        if (m_exportedActions == 0) {
-            qCWarning(unityappmenu, "Failed to export actions - %s", error ? error->message : "unknown error");
-            g_error_free (error);
-            error = nullptr;
-        } else {
-            qCDebug(unityappmenu, "Exported actions on %s", g_dbus_connection_get_unique_name(m_connection));
-        }
+void UnityGMenuModelExporter::customEvent(QEvent *e)
+{
+    if (e->type() == UnityGuiCallEvent::eventType) {
+        auto event = static_cast<UnityGuiCallEvent*>(e);
+        event->invocation = nullptr;
+        event->call();
     }
+}
 
-    if (!m_qtunityExtraHandler) {
-        m_qtunityExtraHandler = new QtUnityExtraActionHandler();
-        if (!m_qtunityExtraHandler->connect(m_connection, menuPath, this)) {
-            delete m_qtunityExtraHandler;
+// Take over the links of all the submenus of the exported tree.
+// They need to be released with releaseSubmenuModels().
+QList<GMenu*> UnityGMenuModelExporter::takeSubmenuModels()
+{
+    const QList<GMenu*> menus = m_gmenusForMenus.values();
+    m_gmenusForMenus.clear();
+    return menus;
+}
+
+void UnityGMenuModelExporter::releaseSubmenuModels(const QList<GMenu*> &menus)
+{
+    Q_FOREACH(GMenu *menu, menus) {
+        UnitySharedMenuModels::instance()->unref(menu);
+    }
+}
+
+// Link the gmenu exported for a platform menu, replacing the previous one.
+void UnityGMenuModelExporter::setSubmenuModel(UnityPlatformMenu *gplatformMenu, GMenu *menu)
+{
+    UnitySharedMenuModels::instance()->ref(menu);
+    GMenu *previousMenu = m_gmenusForMenus.value(gplatformMenu, nullptr);
+    m_gmenusForMenus.insert(gplatformMenu, menu);
+    if (previousMenu) {
+        UnitySharedMenuModels::instance()->unref(previousMenu);
+    }
+}
+
+// Whether the gmenu of the platform menu, or of any of its parents, is linked more than once.
+// Such gmenus must not be modified in place.
+bool UnityGMenuModelExporter::isSharedSubtree(UnityPlatformMenu *gplatformMenu) const
+{
+    for (; gplatformMenu; gplatformMenu = m_parentMenus.value(gplatformMenu, nullptr)) {
+        GMenu *menu = m_gmenusForMenus.value(gplatformMenu, nullptr);
+        if (menu && UnitySharedMenuModels::instance()->links(menu) > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a submenu is exported: top level menus follow their own visibility,
+// the others the visibility of their item.
+bool UnityGMenuModelExporter::isSubmenuVisible(UnityPlatformMenu *gplatformMenu, UnityPlatformMenuItem *forItem)
+{
+    return forItem ? UnityPlatformMenuItem::get_visible(forItem) : UnityPlatformMenu::get_visible(gplatformMenu);
+}
+
+// Forget a platform menu and its submenus once they are not exported any more,
+// dropping their gmenus, actions and connections.
+void UnityGMenuModelExporter::releaseSubtree(UnityPlatformMenu *gplatformMenu)
+{
+    QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> submenus;
+    submenus.append(qMakePair(gplatformMenu, m_parentMenus.value(gplatformMenu, nullptr)));
+    collectSubmenus(gplatformMenu, submenus);
+
+    QList<GMenu*> menus;
+    for (const auto &submenu : submenus) {
+        UnityPlatformMenu* menu = submenu.first;
+        unwatchSubmenu(menu);
+        dropMenuPages(menu);
+        m_searchIndex.removeMenu(menu);
+        for (auto it = m_submenusWithTag.begin(); it != m_submenusWithTag.end();) {
+            if (it.value() == menu) {
+                it = m_submenusWithTag.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_parentMenus.remove(menu);
+        m_evictedMenus.remove(menu);
+        m_lastShown.remove(menu);
+
+        GMenu *gmenu = m_gmenusForMenus.take(menu);
+        if (gmenu) menus.append(gmenu);
+    }
+    m_subtreeHashes.clear();
+
+    // Identical submenus still exported link the same gmenus, and own the same actions
+    const QList<GMenu*> linkedMenus = m_gmenusForMenus.values();
+    QList<GMenu*> releasedMenus;
+    Q_FOREACH(GMenu *menu, menus) {
+        if (!linkedMenus.contains(menu)) releasedMenus.append(menu);
+    }
+    releaseMenuState(releasedMenus);
+    releaseSubmenuModels(menus);
+}
+
+// Remove the actions and property connections of the items of gmenus.
+// Actions of the same name used by the items of other gmenus are kept.
+void UnityGMenuModelExporter::releaseMenuState(const QList<GMenu*> &menus)
+{
+    QSet<QByteArray> actions;
+    Q_FOREACH(GMenu *menu, menus) {
+        Q_FOREACH(const QMetaObject::Connection& connection, m_propertyConnections.take(menu)) {
+            QObject::disconnect(connection);
+        }
+        actions.unite(m_actions.take(menu));
+    }
+    Q_FOREACH(const QSet<QByteArray>& menuActions, m_actions) {
+        actions.subtract(menuActions);
+    }
+    Q_FOREACH(const QByteArray& action, actions) {
+        removeAction(action);
+    }
+}
+
+// Milliseconds after which a submenu which wasn't shown is evicted, see evictSubmenu().
+// 0, the default, keeps all submenus built. Set in seconds with QTUNITY_MENU_EVICT_AFTER.
+int UnityGMenuModelExporter::evictAfter()
+{
+    static const int interval = qBound(0, qgetenv("QTUNITY_MENU_EVICT_AFTER").toInt(), INT_MAX / 1000) * 1000;
+    return interval;
+}
+
+// Mark a submenu and its parents as shown now.
+void UnityGMenuModelExporter::touchSubmenu(UnityPlatformMenu *gplatformMenu)
+{
+    if (evictAfter() == 0) return;
+
+    const qint64 now = m_evictionClock.elapsed();
+    for (; gplatformMenu; gplatformMenu = m_parentMenus.value(gplatformMenu, nullptr)) {
+        m_lastShown.insert(gplatformMenu, now);
+    }
+}
+
+// Evict the submenus which were not shown for coldFor milliseconds.
+void UnityGMenuModelExporter::evictColdSubmenus(qint64 coldFor, bool keepTopLevel)
+{
+    if (evictAfter() == 0) return;
+
+    // Full rebuilds don't tell which menus went away
+    for (auto it = m_lastShown.begin(); it != m_lastShown.end();) {
+        if (m_gmenusForMenus.contains(it.key())) {
+            ++it;
+        } else {
+            it = m_lastShown.erase(it);
+        }
+    }
+
+    const qint64 now = m_evictionClock.elapsed();
+    int evicted = 0;
+    Q_FOREACH(UnityPlatformMenu *gplatformMenu, m_lastShown.keys()) {
+        // Evicting a parent releases its submenus
+        if (!m_lastShown.contains(gplatformMenu) || now - m_lastShown.value(gplatformMenu) < coldFor) continue;
+        if (keepTopLevel && !m_parentMenus.value(gplatformMenu, nullptr)) continue;
+        if (evictSubmenu(gplatformMenu)) evicted++;
+    }
+    if (evicted > 0) {
+        qCDebug(unityappmenu, "%s: evicted %d submenus, %d menus still built", qPrintable(m_menuPath),
+                evicted, m_gmenusForMenus.count() - m_evictedMenus.count());
+    }
+}
+
+// Empty the gmenu of a submenu which is not shown, dropping the actions of its items and
+// the gmenus of its submenus. The gmenu stays linked from its parent, so it is filled again
+// in place by materializeSubmenu() on the next aboutToShow. Only tagged submenus get one,
+// and shared gmenus are still used as they are by other exporters. Returns whether it was evicted.
+bool UnityGMenuModelExporter::evictSubmenu(UnityPlatformMenu *gplatformMenu)
+{
+    GMenu *menu = m_gmenusForMenus.value(gplatformMenu, nullptr);
+    if (!menu || m_evictedMenus.contains(gplatformMenu) || m_reloadMenuTimers.contains(gplatformMenu)) return false;
+
+    const quint64 tag = gplatformMenu->tag();
+    if (tag == 0 || m_submenusWithTag.value(tag, nullptr) != gplatformMenu) return false;
+    if (isSharedSubtree(gplatformMenu) || isPaged(gplatformMenu)) return false;
+
+    // The content is going to change, the gmenus can't be shared any more
+    for (UnityPlatformMenu* m = gplatformMenu; m; m = m_parentMenus.value(m, nullptr)) {
+        GMenu *gmenu = m_gmenusForMenus.value(m, nullptr);
+        if (gmenu) UnitySharedMenuModels::instance()->detach(gmenu);
+    }
+    m_subtreeHashes.clear();
+
+    // The items stay searchable, a search matching them builds the submenu again. The entries of
+    // the submenus go with those of the evicted menu, to be dropped when it is indexed again.
+    QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> subtree;
+    collectSubmenus(gplatformMenu, subtree);
+    for (const auto &submenu : subtree) {
+        m_searchIndex.moveMenu(submenu.first, gplatformMenu);
+    }
+
+    QList<UnityPlatformMenu*> submenus;
+    for (auto parentIt = m_parentMenus.constBegin(); parentIt != m_parentMenus.constEnd(); ++parentIt) {
+        if (parentIt.value() == gplatformMenu) submenus.append(parentIt.key());
+    }
+    Q_FOREACH(UnityPlatformMenu *submenu, submenus) {
+        if (m_gmenusForMenus.contains(submenu)) {
+            releaseSubtree(submenu);
+        } else {
+            m_parentMenus.remove(submenu);
+        }
+    }
+    releaseMenuState(QList<GMenu*>() << menu);
+
+    GMenu *placeholder = g_menu_new();
+    setMenuItems(menu, placeholder);
+    g_object_unref(placeholder);
+
+    m_evictedMenus.insert(gplatformMenu);
+    recordChange(tag, QByteArray());
+    return true;
+}
+
+// Build the content of an evicted submenu again, in its exported gmenu.
+void UnityGMenuModelExporter::materializeSubmenu(UnityPlatformMenu *gplatformMenu)
+{
+    if (!m_evictedMenus.remove(gplatformMenu)) return;
+
+    GMenu *menu = m_gmenusForMenus.value(gplatformMenu, nullptr);
+    if (!menu) return;
+
+    GMenu *content = g_menu_new();
+    addSubmenuItems(gplatformMenu, content);
+    moveMenuItemsState(content, menu);
+    setMenuItems(menu, content);
+    g_object_unref(content);
+    recordChange(gplatformMenu->tag(), QByteArray());
+}
+
+// Evict the cold submenus once the window of the menus is in the background, earlier than
+// the eviction timer would. The top level menus stay built, they are the first ones shown
+// when the window is back.
+void UnityGMenuModelExporter::watchWindow(QWindow *window)
+{
+    if (window == m_window) return;
+    if (m_window) {
+        disconnect(m_window.data(), nullptr, this, nullptr);
+    }
+    m_window = window;
+    if (!window || evictAfter() == 0) return;
+
+    connect(window, &QWindow::activeChanged, this, [this, window]() {
+        if (!window->isActive()) evictColdSubmenus(qMin<qint64>(s_backgroundColdness, evictAfter()), true);
+    });
+    connect(window, &QWindow::windowStateChanged, this, [this](Qt::WindowState state) {
+        if (state == Qt::WindowMinimized) evictColdSubmenus(qMin<qint64>(s_backgroundColdness, evictAfter()), true);
+    });
+}
+
+// Collect the exported submenus of a platform menu depth first, in the order addSubmenuItems()
+// creates them, along with their parent menu.
+void UnityGMenuModelExporter::collectSubmenus(UnityPlatformMenu *gplatformMenu, QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> &submenus)
+{
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+        if (!gplatformMenuItem || UnityPlatformMenuItem::get_separator(gplatformMenuItem)) continue;
+
+        UnityPlatformMenu* gplatformSubmenu = static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu());
+        if (!gplatformSubmenu || !isSubmenuVisible(gplatformSubmenu, gplatformMenuItem)) continue;
+
+        submenus.append(qMakePair(gplatformSubmenu, gplatformMenu));
+        collectSubmenus(gplatformSubmenu, submenus);
+    }
+}
+
+// Hash of the content addSubmenuItems() exports for a platform menu.
+// Identical hashes allow exporters to share the gmenu of a submenu.
+// Empty for menus which can't be shared: the pages of paged menus are revealed per exporter.
+// The prefix is the one of the top level menu, and the path the one of menuIndexPath(), as
+// m_parentMenus isn't filled in while building.
+QByteArray UnityGMenuModelExporter::subtreeHash(UnityPlatformMenu *gplatformMenu, const QByteArray &prefix,
+                                                const QByteArray &path)
+{
+    auto it = m_subtreeHashes.constFind(gplatformMenu);
+    if (it != m_subtreeHashes.constEnd()) return *it;
+
+    if (isPaged(gplatformMenu)) {
+        m_subtreeHashes.insert(gplatformMenu, QByteArray());
+        return QByteArray();
+    }
+    bool shareable = true;
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    auto addString = [&hash](const QString &string) {
+        const QByteArray data(string.toUtf8());
+        const quint32 size = data.size();
+        hash.addData(reinterpret_cast<const char*>(&size), sizeof(size));
+        hash.addData(data);
+    };
+
+    const QHash<UnityPlatformMenuItem*, QByteArray> groups = radioGroups(gplatformMenu, prefix, path);
+    const char collapsible = UnityPlatformMenu::get_separatorsCollapsible(gplatformMenu) ? 'c' : 'n';
+    hash.addData(&collapsible, sizeof(collapsible));
+    // The action names of the items depend on the group of their top level menu
+    addString(QString::fromLatin1(prefix));
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    for (int i = 0; i < menuItems.count(); ++i) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+        if (!gplatformMenuItem) continue;
+
+        UnityPlatformMenu* gplatformSubmenu = static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu());
+        const char flags[] = {
+            UnityPlatformMenuItem::get_separator(gplatformMenuItem) ? 's' : 'i',
+            UnityPlatformMenuItem::get_visible(gplatformMenuItem) ? 'v' : 'h',
+            UnityPlatformMenuItem::get_checkable(gplatformMenuItem) ? 'c' : 'n',
+            // the enabled state of plain items lives in the action group
+            gplatformSubmenu && UnityPlatformMenuItem::get_enabled(gplatformMenuItem) ? 'e' : 'd',
+            gplatformSubmenu && gplatformSubmenu->tag() != 0 ? 't' : 'n'
+        };
+        hash.addData(flags, sizeof(flags));
+        addString(UnityPlatformMenuItem::get_text(gplatformMenuItem));
+        addString(UnityPlatformMenuItem::get_shortcut(gplatformMenuItem).toString(QKeySequence::NativeText));
+        addString(QString::fromUtf8(groups.value(gplatformMenuItem)));
+        if (gplatformSubmenu && isSubmenuVisible(gplatformSubmenu, gplatformMenuItem)) {
+            const QByteArray submenuHash = subtreeHash(gplatformSubmenu, prefix, submenuIndexPath(path, i));
+            shareable = shareable && !submenuHash.isEmpty();
+            hash.addData(submenuHash);
+        }
+    }
+
+    const QByteArray result = shareable ? hash.result() : QByteArray();
+    m_subtreeHashes.insert(gplatformMenu, result);
+    return result;
+}
+
+void UnityGMenuModelExporter::timerEvent(QTimerEvent *e)
+{
+    // Find the menu, it's a very short list
+    auto it = m_reloadMenuTimers.begin();
+    for (; it != m_reloadMenuTimers.end(); ++it) {
+        if (e->timerId() == it.value())
+            break;
+    }
+
+    if (it != m_reloadMenuTimers.end()) {
+        UnityPlatformMenu* gplatformMenu = it.key();
+        m_reloadMenuTimers.erase(it);
+
+        GMenu *menu = m_gmenusForMenus.value(gplatformMenu);
+        if (menu && isSharedSubtree(gplatformMenu)) {
+            // Copy on write, rebuild the whole tree so the changed submenu gets its own gmenus
+            m_structureTimer.start();
+        } else if (menu && m_evictedMenus.contains(gplatformMenu)) {
+            // Nothing is exported, the new content is built when it is shown again
+        } else if (menu) {
+            // The content is going to change, the gmenus can't be shared any more
+            for (UnityPlatformMenu* m = gplatformMenu; m; m = m_parentMenus.value(m, nullptr)) {
+                GMenu *gmenu = m_gmenusForMenus.value(m, nullptr);
+                if (gmenu) UnitySharedMenuModels::instance()->detach(gmenu);
+            }
+            m_subtreeHashes.clear();
+
+            // Submenus which were hidden are not exported any more
+            Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+                UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+                UnityPlatformMenu* gplatformSubmenu = gplatformMenuItem ? static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu()) : nullptr;
+                if (gplatformSubmenu && !isSubmenuVisible(gplatformSubmenu, gplatformMenuItem) &&
+                        m_gmenusForMenus.contains(gplatformSubmenu)) {
+                    releaseSubtree(gplatformSubmenu);
+                }
+            }
+            releaseMenuState(QList<GMenu*>() << menu);
+            dropMenuPages(gplatformMenu);
+
+            QList<UnityPlatformMenu*> previousSubmenus;
+            for (auto parentIt = m_parentMenus.constBegin(); parentIt != m_parentMenus.constEnd(); ++parentIt) {
+                if (parentIt.value() == gplatformMenu) previousSubmenus.append(parentIt.key());
+            }
+
+            // Submenus which moved within the menu would keep the radio action names of their
+            // previous position, which a submenu built there takes. They are built again.
+            Q_FOREACH(UnityPlatformMenu *previousSubmenu, previousSubmenus) {
+                if (m_gmenusForMenus.contains(previousSubmenu) && hasMovedRadioGroups(previousSubmenu)) {
+                    releaseSubtree(previousSubmenu);
+                }
+            }
+
+            // Build the new content on the side, the exported gmenu is replaced in one go.
+            // Only this level is rebuilt, the gmenus of the submenus are linked again.
+            GMenu *content = g_menu_new();
+            addSubmenuItems(gplatformMenu, content);
+            moveMenuItemsState(content, menu);
+            setMenuItems(menu, content);
+            g_object_unref(content);
+
+            // Submenus which were removed from the menu are not exported any more
+            QSet<QPlatformMenu*> submenus;
+            Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+                if (platformMenuItem && platformMenuItem->menu()) submenus.insert(platformMenuItem->menu());
+            }
+            Q_FOREACH(UnityPlatformMenu *previousSubmenu, previousSubmenus) {
+                if (!submenus.contains(previousSubmenu) && m_gmenusForMenus.contains(previousSubmenu) &&
+                        m_parentMenus.value(previousSubmenu, nullptr) == gplatformMenu) {
+                    releaseSubtree(previousSubmenu);
+                }
+            }
+            recordChange(gplatformMenu->tag(), QByteArray());
+        } else {
+            qWarning() << "Got an update timer for a menu that has no GMenu" << gplatformMenu;
+        }
+    } else {
+        qWarning() << "Got an update timer for a timer that was not running";
+    }
+    killTimer(e->timerId());
+}
+
+// Export the model on dbus
+void UnityGMenuModelExporter::exportModels()
+{
+    if (!m_connection) {
+        GError *error = nullptr;
+        m_connection = g_bus_get_sync (G_BUS_TYPE_SESSION, nullptr, &error);
+        if (!m_connection) {
+            qCWarning(unityappmenu, "Failed to retreive session bus - %s", error ? error->message : "unknown error");
+            g_error_free (error);
+            return;
+        }
+    }
+
+    // With the export thread, the exports dispatch on its context, which must be the thread default one
+    // when exporting.
+    if (m_threaded) {
+        UnityMenuExportThread::instance()->invokeSync([this]() { exportModelsOnConnection(); });
+    } else {
+        // Otherwise they dispatch on the default context, which the Qt event loop may not iterate
+        UnityMainLoopBridge::ensure();
+        exportModelsOnConnection();
+    }
+}
+
+void UnityGMenuModelExporter::exportModelsOnConnection()
+{
+    GError *error = nullptr;
+    QByteArray menuPath(m_menuPath.toUtf8());
+
+    if (m_exportedModel == 0) {
+        m_exportedModel = g_dbus_connection_export_menu_model(m_connection, menuPath.constData(), G_MENU_MODEL(m_gmainMenu), &error);
+        if (m_exportedModel == 0) {
+            qCWarning(unityappmenu, "Failed to export menu - %s", error ? error->message : "unknown error");
+            g_error_free (error);
+            error = nullptr;
+        } else {
+            qCDebug(unityappmenu, "Exported menu on %s", g_dbus_connection_get_unique_name(m_connection));
+        }
+    }
+
+    if (m_exportedActions == 0) {
+        m_exportedActions = g_dbus_connection_export_action_group(m_connection, menuPath.constData(), G_ACTION_GROUP(m_gactionGroup), &error);
+        if (m_exportedActions == 0) {
+            qCWarning(unityappmenu, "Failed to export actions - %s", error ? error->message : "unknown error");
+            g_error_free (error);
+            error = nullptr;
+        } else {
+            qCDebug(unityappmenu, "Exported actions on %s", g_dbus_connection_get_unique_name(m_connection));
+        }
+    }
+
+    Q_FOREACH(UnitySplitActionGroup *splitGroup, m_splitActionGroups) {
+        if (splitGroup->exportId != 0) continue;
+
+        splitGroup->exportId = g_dbus_connection_export_action_group(m_connection, splitGroup->path.constData(),
+                                                                     G_ACTION_GROUP(splitGroup->group), &error);
+        if (splitGroup->exportId == 0) {
+            qCWarning(unityappmenu, "Failed to export actions on %s - %s", splitGroup->path.constData(),
+                      error ? error->message : "unknown error");
+            g_error_free (error);
+            error = nullptr;
+        }
+    }
+
+    if (!m_qtunityExtraHandler) {
+        m_qtunityExtraHandler = new QtUnityExtraActionHandler();
+        if (!m_qtunityExtraHandler->connect(m_connection, menuPath, this)) {
+            delete m_qtunityExtraHandler;
             m_qtunityExtraHandler = nullptr;
         }
     }
 }
 
-void UnityGMenuModelExporter::aboutToShow(quint64 tag)
+// May be called from the export thread.
+void UnityGMenuModelExporter::aboutToShow(quint64 tag)
+{
+    runInGuiThread([this, tag]() {
+        if (m_menuPages.contains(tag)) {
+            revealMenuPage(tag);
+            return;
+        }
+
+        UnityPlatformMenu* gplatformMenu = m_submenusWithTag.value(tag);
+        if (!gplatformMenu) {
+            qWarning() << "Got an aboutToShow call with an unknown tag";
+            return;
+        }
+
+        UnityMenuTrace::record(UnityMenuTrace::AboutToShow, gplatformMenu);
+        materializeSubmenu(gplatformMenu);
+        touchSubmenu(gplatformMenu);
+        gplatformMenu->aboutToShow();
+    });
+}
+
+// Answer a search of the HUD with the best matching enabled items, as
+// (action, activation parameters, label, submenu labels) tuples.
+// May be called from the export thread, takes over the invocation.
+void UnityGMenuModelExporter::search(const QString &query, uint limit, GDBusMethodInvocation *invocation)
+{
+    runInGuiThread([this, query, limit, invocation]() {
+        // Evicted submenus keep their entries but not their actions, and their content may
+        // have changed since. The ones with matches are built again.
+        Q_FOREACH(const QObject *menu, m_searchIndex.matchingMenus(query)) {
+            UnityPlatformMenu *gplatformMenu = static_cast<UnityPlatformMenu*>(const_cast<QObject*>(menu));
+            if (m_evictedMenus.contains(gplatformMenu)) {
+                materializeSubmenu(gplatformMenu);
+                touchSubmenu(gplatformMenu);
+            }
+        }
+
+        const QVector<UnityMenuSearchIndex::Result> results =
+            m_searchIndex.search(query, static_cast<int>(qMin(limit, static_cast<uint>(INT_MAX))), [this](const QByteArray &action) {
+                // Actions can go away before the menu of their items is indexed again
+                auto it = m_menuActions.constFind(action);
+                return it != m_menuActions.constEnd() && it->enabled;
+            });
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a(savsas)"));
+        Q_FOREACH(const UnityMenuSearchIndex::Result &result, results) {
+            g_variant_builder_open(&builder, G_VARIANT_TYPE("(savsas)"));
+            g_variant_builder_add(&builder, "s", result.action.constData());
+            g_variant_builder_open(&builder, G_VARIANT_TYPE("av"));
+            if (!result.target.isEmpty()) {
+                g_variant_builder_add(&builder, "v", g_variant_new_string(result.target.constData()));
+            }
+            g_variant_builder_close(&builder);
+            g_variant_builder_add(&builder, "s", result.label.toUtf8().constData());
+            g_variant_builder_open(&builder, G_VARIANT_TYPE("as"));
+            Q_FOREACH(const QString &submenu, result.path) {
+                g_variant_builder_add(&builder, "s", submenu.toUtf8().constData());
+            }
+            g_variant_builder_close(&builder);
+            g_variant_builder_close(&builder);
+        }
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(a(savsas))", &builder));
+    }, invocation);
+}
+
+// Answer a layout request with the items of the submenu of the given tag, or of the
+// whole tree for tag 0, expanding submenus at most depth levels deep (-1 for no limit).
+// This saves the shell the round trips of subscribing to every group of the exported menus.
+// May be called from the export thread, takes over the invocation.
+void UnityGMenuModelExporter::layout(quint64 tag, int depth, GDBusMethodInvocation *invocation)
+{
+    runInGuiThread([this, tag, depth, invocation]() {
+        GVariant *items = nullptr;
+        if (tag == 0) {
+            items = rootLayout(depth);
+        } else if (UnityPlatformMenu* gplatformMenu = m_submenusWithTag.value(tag)) {
+            items = menuLayout(gplatformMenu, depth);
+        } else {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Unknown menu tag");
+            return;
+        }
+        g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&items, 1));
+    }, invocation);
+}
+
+// The layout of the visible items of a platform menu, as an aa{sv}. The sections are split
+// like the exported ones, with a separator between those showing items.
+GVariant *UnityGMenuModelExporter::menuLayout(UnityPlatformMenu *gplatformMenu, int depth)
+{
+    const QByteArray prefix = actionPrefix(gplatformMenu);
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    bool hasItems = false;
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    for (const QPair<int, int> &section : menuSections(gplatformMenu, 0, menuItems.count())) {
+        bool sectionStarted = false;
+        for (int i = section.first; i < section.second; ++i) {
+            UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+            if (!gplatformMenuItem || !UnityPlatformMenuItem::get_visible(gplatformMenuItem)) continue;
+
+            UnityPlatformMenu* submenu = static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu());
+            if (submenu && !isSubmenuVisible(submenu, gplatformMenuItem)) continue;
+
+            // The separator before the section
+            if (hasItems && !sectionStarted) {
+                g_variant_builder_add_value(&builder, itemLayout(static_cast<UnityPlatformMenuItem*>(menuItems.at(section.first - 1)),
+                                                                 prefix));
+            }
+            hasItems = true;
+            sectionStarted = true;
+
+            if (submenu) {
+                g_variant_builder_add_value(&builder, submenuLayout(submenu, gplatformMenuItem, depth));
+            } else {
+                g_variant_builder_add_value(&builder, itemLayout(gplatformMenuItem, prefix));
+            }
+        }
+    }
+    return g_variant_builder_end(&builder);
+}
+
+// The layout of a menu item without submenu, as an a{sv}.
+GVariant *UnityGMenuModelExporter::itemLayout(UnityPlatformMenuItem *gplatformMenuItem, const QByteArray &prefix)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+    if (UnityPlatformMenuItem::get_separator(gplatformMenuItem)) {
+        g_variant_builder_add(&builder, "{sv}", "separator", g_variant_new_boolean(TRUE));
+        return g_variant_builder_end(&builder);
+    }
+
+    const QString label = UnityPlatformMenuItem::get_text(gplatformMenuItem);
+    const QByteArray actionLabel(getActionString(label).toUtf8());
+    const QByteArray shortcut(UnityPlatformMenuItem::get_shortcut(gplatformMenuItem).toString(QKeySequence::NativeText).toUtf8());
+    const QByteArray radioGroup = m_radioGroups.value(gplatformMenuItem);
+
+    g_variant_builder_add(&builder, "{sv}", "label", g_variant_new_string(label.toUtf8().constData()));
+    g_variant_builder_add(&builder, "{sv}", "accel", g_variant_new_string(shortcut.constData()));
+    g_variant_builder_add(&builder, "{sv}", "enabled", g_variant_new_boolean(UnityPlatformMenuItem::get_enabled(gplatformMenuItem)));
+    if (UnityPlatformMenuItem::get_checkable(gplatformMenuItem)) {
+        g_variant_builder_add(&builder, "{sv}", "checked", g_variant_new_boolean(UnityPlatformMenuItem::get_checked(gplatformMenuItem)));
+    }
+    if (!radioGroup.isEmpty()) {
+        g_variant_builder_add(&builder, "{sv}", "action", g_variant_new_string(radioGroup.constData()));
+        g_variant_builder_add(&builder, "{sv}", "target", g_variant_new_string(actionLabel.constData()));
+    } else {
+        g_variant_builder_add(&builder, "{sv}", "action", g_variant_new_string((prefix + '.' + actionLabel).constData()));
+    }
+    return g_variant_builder_end(&builder);
+}
+
+// The layout of a submenu, as an a{sv}. Its items are only included while depth allows,
+// the tag allows fetching them later otherwise.
+GVariant *UnityGMenuModelExporter::submenuLayout(UnityPlatformMenu *gplatformMenu, UnityPlatformMenuItem *forItem, int depth)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+    QString label;
+    bool enabled;
+    if (forItem) {
+        label = UnityPlatformMenuItem::get_text(forItem);
+        enabled = UnityPlatformMenuItem::get_enabled(forItem);
+    } else {
+        label = UnityPlatformMenu::get_text(gplatformMenu);
+        enabled = UnityPlatformMenu::get_enabled(gplatformMenu);
+    }
+
+    g_variant_builder_add(&builder, "{sv}", "label", g_variant_new_string(label.toUtf8().constData()));
+    g_variant_builder_add(&builder, "{sv}", "enabled", g_variant_new_boolean(enabled));
+    if (gplatformMenu->tag() != 0) {
+        g_variant_builder_add(&builder, "{sv}", "tag", g_variant_new_uint64(gplatformMenu->tag()));
+    }
+    UnitySplitActionGroup *splitGroup = m_splitActionGroups.value(m_actionPrefixes.value(gplatformMenu), nullptr);
+    if (splitGroup) {
+        g_variant_builder_add(&builder, "{sv}", "actions",
+                              g_variant_new("(so)", splitGroup->prefix.constData(), splitGroup->path.constData()));
+    }
+    if (depth != 0) {
+        g_variant_builder_add(&builder, "{sv}", "submenu", menuLayout(gplatformMenu, depth > 0 ? depth - 1 : depth));
+    }
+    return g_variant_builder_end(&builder);
+}
+
+// Bump the revision for a change of the items of the submenu of the given tag (0 for the
+// whole tree), or of the state of an action.
+void UnityGMenuModelExporter::recordChange(quint64 tag, const QByteArray &action)
+{
+    m_journal.enqueue(UnityMenuChange{++m_revision, tag, action});
+    if (m_journal.count() > s_journalLength) {
+        m_journalStart = m_journal.dequeue().revision;
+    }
+
+    if (verifyExport() && !m_verifyTimer.isActive()) {
+        m_verifyTimer.start();
+    }
+}
+
+// Describe the items of a platform menu the way they should be exported: one line per
+// visible item with its action state, submenus indented below their item, and the groups
+// of items between separators split by "--" lines. Paged menus are described from the
+// given item on, up to the pages revealed so far.
+QString UnityGMenuModelExporter::describeMenu(UnityPlatformMenu *gplatformMenu, int indent, int first)
+{
+    const QString prefix(indent, QLatin1Char(' '));
+    QStringList groups;
+    QString group;
+
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    const int size = pageSize(gplatformMenu);
+    first = qMin(first, menuItems.count());
+    const int last = size > 0 && menuItems.count() - first > size ? first + size : menuItems.count();
+    const QByteArray actionPrefix = this->actionPrefix(gplatformMenu);
+    // Whether the items go in sections, the continuation then comes in a group of its own
+    bool inSection = false;
+
+    for (int i = first; i < last; ++i) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+        if (!gplatformMenuItem) continue;
+
+        if (gplatformMenuItem->menu()) {
+            if (!UnityPlatformMenuItem::get_visible(gplatformMenuItem)) continue;
+            group += describeSubmenu(static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu()), gplatformMenuItem, indent);
+            continue;
+        }
+        if (UnityPlatformMenuItem::get_separator(gplatformMenuItem)) {
+            if (!group.isEmpty()) groups << group;
+            group.clear();
+            inSection = true;
+            continue;
+        }
+        if (!UnityPlatformMenuItem::get_visible(gplatformMenuItem)) continue;
+
+        const QString label = UnityPlatformMenuItem::get_text(gplatformMenuItem);
+        const QByteArray actionLabel(getActionString(label).toUtf8());
+        const QByteArray radioGroup = m_radioGroups.value(gplatformMenuItem);
+
+        GVariant *target = nullptr;
+        GVariant *state = nullptr;
+        if (!radioGroup.isEmpty()) {
+            target = g_variant_ref_sink(g_variant_new_string(actionLabel.constData()));
+            QByteArray checkedTarget;
+            Q_FOREACH(QPlatformMenuItem *platformGroupItem, gplatformMenu->menuItems()) {
+                UnityPlatformMenuItem* groupItem = static_cast<UnityPlatformMenuItem*>(platformGroupItem);
+                if (m_radioGroups.value(groupItem) == radioGroup && UnityPlatformMenuItem::get_checked(groupItem)) {
+                    checkedTarget = getActionString(UnityPlatformMenuItem::get_text(groupItem)).toUtf8();
+                }
+            }
+            state = g_variant_ref_sink(g_variant_new_string(checkedTarget.constData()));
+        } else if (UnityPlatformMenuItem::get_checkable(gplatformMenuItem)) {
+            state = g_variant_ref_sink(g_variant_new_boolean(UnityPlatformMenuItem::get_checked(gplatformMenuItem)));
+        }
+
+        group += prefix + label;
+        group += QStringLiteral(" action=%1 target=%2 enabled=%3 state=%4\n")
+            .arg(QString::fromUtf8(radioGroup.isEmpty() ? actionPrefix + '.' + actionLabel : radioGroup))
+            .arg(print_variant(target))
+            .arg(UnityPlatformMenuItem::get_enabled(gplatformMenuItem) ? 1 : 0)
+            .arg(print_variant(state));
+        if (target) {
+            g_variant_unref(target);
+        }
+        if (state) {
+            g_variant_unref(state);
+        }
+    }
+
+    if (last < menuItems.count()) {
+        if (inSection) {
+            if (!group.isEmpty()) groups << group;
+            group.clear();
+        }
+
+        bool revealed = false;
+        Q_FOREACH(const UnityMenuPage &page, m_menuPages) {
+            revealed = revealed || (page.menu == gplatformMenu && page.first == last && page.revealed);
+        }
+        group += prefix + QCoreApplication::translate("UnityGMenuModelExporter", "More") + QStringLiteral(" submenu enabled=1\n");
+        if (revealed) {
+            group += describeMenu(gplatformMenu, indent + 2, last);
+        }
+    }
+    if (!group.isEmpty()) groups << group;
+
+    return groups.join(prefix + QStringLiteral("--\n"));
+}
+
+QString UnityGMenuModelExporter::describeSubmenu(UnityPlatformMenu *gplatformMenu, UnityPlatformMenuItem *forItem, int indent)
+{
+    QString label;
+    bool enabled;
+    if (forItem) {
+        label = UnityPlatformMenuItem::get_text(forItem);
+        enabled = UnityPlatformMenuItem::get_enabled(forItem);
+    } else {
+        label = UnityPlatformMenu::get_text(gplatformMenu);
+        enabled = UnityPlatformMenu::get_enabled(gplatformMenu);
+    }
+
+    const QString description = QString(indent, QLatin1Char(' ')) + label +
+        QStringLiteral(" submenu enabled=%1\n").arg(enabled ? 1 : 0);
+    // Evicted submenus are exported empty
+    return m_evictedMenus.contains(gplatformMenu) ? description : description + describeMenu(gplatformMenu, indent + 2);
+}
+
+// Check that the exported models match the platform menus, once all updates are flushed.
+// Enabled with QTUNITY_MENU_VERIFY, along with a report of the update rate.
+void UnityGMenuModelExporter::verifyModels()
+{
+    if (m_structureTimer.isActive() || !m_reloadMenuTimers.isEmpty() || m_actionUpdateTimer.isActive()) {
+        m_verifyTimer.start();
+        return;
+    }
+
+    const qint64 elapsed = qMax<qint64>(m_statisticsTimer.restart(), 1);
+    // Emitted on the export context, some may still be queued there
+    const int modelSignals = m_modelSignals ? m_modelSignals->count.fetchAndStoreRelaxed(0) : 0;
+    qCDebug(unityappmenuTiming, "%s: %d mutations in %lld ms (%.1f/s), %.2f model signals per mutation, %d submenus relinked",
+            qPrintable(m_menuPath), m_mutationCount, elapsed, m_mutationCount * 1000.0 / elapsed,
+            m_mutationCount ? static_cast<double>(modelSignals) / m_mutationCount : 0.0, m_reusedSubmenuCount);
+    m_mutationCount = 0;
+    m_reusedSubmenuCount = 0;
+    GVariant *counts = g_variant_ref_sink(liveCounts());
+    qCDebug(unityappmenuTiming, "%s: live counts %s", qPrintable(m_menuPath), qPrintable(print_variant(counts)));
+    g_variant_unref(counts);
+
+    const QString expected = describeRoot();
+    // The layouts list all the items, paged and evicted menus are only exported in part
+    const bool checkLayout = m_menuPages.isEmpty() && m_evictedMenus.isEmpty();
+    QString expectedLayout;
+    if (checkLayout) {
+        GVariant *layout = g_variant_ref_sink(rootLayout(-1));
+        expectedLayout = describe_layout(layout, 0);
+        g_variant_unref(layout);
+    }
+    const QString menuPath = m_menuPath;
+    GMenu *menu = m_gmainMenu;
+    QHash<QByteArray, GActionGroup*> actionGroups;
+    actionGroups.insert("unity", G_ACTION_GROUP(m_gactionGroup));
+    Q_FOREACH(const UnitySplitActionGroup *splitGroup, m_splitActionGroups) {
+        actionGroups.insert(splitGroup->prefix, G_ACTION_GROUP(splitGroup->group));
+    }
+    g_object_ref(menu);
+    Q_FOREACH(GActionGroup *actionGroup, actionGroups) {
+        g_object_ref(actionGroup);
+    }
+    runInExportContext([expected, checkLayout, expectedLayout, menuPath, menu, actionGroups]() {
+        const QString exported = describe_model(G_MENU_MODEL(menu), actionGroups, 0);
+        if (exported != expected) {
+            qCWarning(unityappmenu).noquote() << "Exported menu" << menuPath << "doesn't match its platform menu\nexpected:\n"
+                                              << expected << "exported:\n" << exported;
+        }
+        const QString exportedLayout = checkLayout ? describe_model_layout(G_MENU_MODEL(menu), 0) : QString();
+        if (exportedLayout != expectedLayout) {
+            qCWarning(unityappmenu).noquote() << "Exported menu" << menuPath << "doesn't match its layout\nlayout:\n"
+                                              << expectedLayout << "exported:\n" << exportedLayout;
+        }
+        Q_FOREACH(GActionGroup *actionGroup, actionGroups) {
+            g_object_unref(actionGroup);
+        }
+        g_object_unref(menu);
+    });
+}
+
+// The sizes of the state kept by the exporter, and of the process, as an a{sv}.
+// None of them should grow while an app only keeps updating the same menus.
+GVariant *UnityGMenuModelExporter::liveCounts() const
+{
+    int propertyConnections = 0;
+    Q_FOREACH(const QVector<QMetaObject::Connection>& menuPropertyConnections, m_propertyConnections) {
+        propertyConnections += menuPropertyConnections.count();
+    }
+    // Every connection to the watched menus and their items, those of popup exporters and of Qt included
+    int qtConnections = 0;
+    Q_FOREACH(UnityPlatformMenu *gplatformMenu, m_watchedMenus) {
+        qtConnections += gplatformMenu->connectionCount();
+        Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+            qtConnections += static_cast<UnityPlatformMenuItem*>(platformMenuItem)->connectionCount();
+        }
+    }
+    if (UnityPlatformMenuBar *bar = qobject_cast<UnityPlatformMenuBar*>(parent())) {
+        qtConnections += bar->connectionCount();
+    }
+    // Only counted when GOBJECT_DEBUG has instance-count
+    const int gobjects = g_type_get_instance_count(G_TYPE_MENU) + g_type_get_instance_count(G_TYPE_MENU_ITEM) +
+                         g_type_get_instance_count(UNITY_TYPE_MENU_ACTION_GROUP);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "actions", g_variant_new_int32(m_menuActions.count()));
+    g_variant_builder_add(&builder, "{sv}", "menus", g_variant_new_int32(m_gmenusForMenus.count()));
+    g_variant_builder_add(&builder, "{sv}", "parentMenus", g_variant_new_int32(m_parentMenus.count()));
+    g_variant_builder_add(&builder, "{sv}", "evictedMenus", g_variant_new_int32(m_evictedMenus.count()));
+    g_variant_builder_add(&builder, "{sv}", "taggedMenus", g_variant_new_int32(m_submenusWithTag.count()));
+    g_variant_builder_add(&builder, "{sv}", "watchedMenus", g_variant_new_int32(m_watchedMenus.count()));
+    g_variant_builder_add(&builder, "{sv}", "pendingReloads", g_variant_new_int32(m_reloadMenuTimers.count()));
+    g_variant_builder_add(&builder, "{sv}", "radioGroups", g_variant_new_int32(m_radioGroups.count()));
+    g_variant_builder_add(&builder, "{sv}", "splitActionGroups", g_variant_new_int32(m_splitActionGroups.count()));
+    g_variant_builder_add(&builder, "{sv}", "propertyConnections", g_variant_new_int32(propertyConnections));
+    g_variant_builder_add(&builder, "{sv}", "qtConnections", g_variant_new_int32(qtConnections));
+    g_variant_builder_add(&builder, "{sv}", "journal", g_variant_new_int32(m_journal.count()));
+    g_variant_builder_add(&builder, "{sv}", "processExporters", g_variant_new_int32(s_exporterCount));
+    g_variant_builder_add(&builder, "{sv}", "processMenuModels", g_variant_new_int32(UnitySharedMenuModels::instance()->count()));
+    g_variant_builder_add(&builder, "{sv}", "processGObjects", g_variant_new_int32(gobjects));
+    g_variant_builder_add(&builder, "{sv}", "processRss", g_variant_new_int64(residentSetSize()));
+    return g_variant_builder_end(&builder);
+}
+
+// Answer a statistics request with liveCounts(), so long running apps can be checked for leaks.
+// May be called from the export thread, takes over the invocation.
+void UnityGMenuModelExporter::statistics(GDBusMethodInvocation *invocation)
+{
+    runInGuiThread([this, invocation]() {
+        GVariant *counts = liveCounts();
+        g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&counts, 1));
+    }, invocation);
+}
+
+// Answer what changed after the given revision: the submenus to fetch again and the current
+// state of the changed actions. When the journal doesn't go back that far, asks for a resync.
+// May be called from the export thread, takes over the invocation.
+void UnityGMenuModelExporter::changesSince(quint64 revision, GDBusMethodInvocation *invocation)
+{
+    runInGuiThread([this, revision, invocation]() {
+        QList<quint64> tags;
+        QList<QByteArray> actions;
+        const bool resync = !collectChanges(revision, tags, actions);
+
+        GVariantBuilder tagsBuilder;
+        g_variant_builder_init(&tagsBuilder, G_VARIANT_TYPE("at"));
+        Q_FOREACH(quint64 tag, tags) {
+            g_variant_builder_add(&tagsBuilder, "t", tag);
+        }
+
+        GVariant *actionsValue = actionStates(actions);
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(tbat@a(sbav))", m_revision, resync,
+                                                                        &tagsBuilder, actionsValue));
+    }, invocation);
+}
+
+// The submenu tags and actions which changed after the given revision, in the order they
+// first changed. Returns false if the journal doesn't go back that far.
+bool UnityGMenuModelExporter::collectChanges(quint64 revision, QList<quint64> &tags, QList<QByteArray> &actions) const
+{
+    if (revision < m_journalStart || revision > m_revision) return false;
+
+    Q_FOREACH(const UnityMenuChange &change, m_journal) {
+        if (change.revision <= revision) continue;
+
+        if (change.action.isEmpty()) {
+            if (!tags.contains(change.tag)) tags.append(change.tag);
+        } else if (!actions.contains(change.action)) {
+            actions.append(change.action);
+        }
+    }
+    return true;
+}
+
+// The current state of actions, as an a(sbav) of (action, enabled, state).
+GVariant *UnityGMenuModelExporter::actionStates(const QList<QByteArray> &actions) const
+{
+    GVariantBuilder actionsBuilder;
+    g_variant_builder_init(&actionsBuilder, G_VARIANT_TYPE("a(sbav)"));
+    Q_FOREACH(const QByteArray &action, actions) {
+        auto it = m_menuActions.constFind(action);
+        // Removed actions come with the change of the items of their menu
+        if (it == m_menuActions.constEnd()) continue;
+
+        g_variant_builder_open(&actionsBuilder, G_VARIANT_TYPE("(sbav)"));
+        g_variant_builder_add(&actionsBuilder, "s", action.constData());
+        g_variant_builder_add(&actionsBuilder, "b", it->enabled);
+        g_variant_builder_open(&actionsBuilder, G_VARIANT_TYPE("av"));
+        if (it->radio) {
+            g_variant_builder_add(&actionsBuilder, "v", g_variant_new_string(it->checkedTarget.constData()));
+        } else if (it->checkable) {
+            g_variant_builder_add(&actionsBuilder, "v", g_variant_new_boolean(it->checked));
+        }
+        g_variant_builder_close(&actionsBuilder);
+        g_variant_builder_close(&actionsBuilder);
+    }
+    return g_variant_builder_end(&actionsBuilder);
+}
+
+// Answer a layout transfer request with a sealed memfd holding a generation of the layout,
+// see menulayoutbuffer.h. A generation holds the layout of the whole tree, or only the
+// submenus and actions which changed after the given revision when the journal allows it.
+// May be called from the export thread, takes over the invocation.
+void UnityGMenuModelExporter::layoutBuffer(quint64 revision, int depth, GDBusMethodInvocation *invocation)
+{
+    runInGuiThread([this, revision, depth, invocation]() {
+        GDBusConnection *connection = g_dbus_method_invocation_get_connection(invocation);
+        if (!(g_dbus_connection_get_capabilities(connection) & G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                                                  "The connection can't pass file descriptors");
+            return;
+        }
+
+        QList<quint64> tags;
+        QList<QByteArray> actions;
+        const bool incremental = revision != 0 && collectChanges(revision, tags, actions) && !tags.contains(0);
+
+        GVariantBuilder submenusBuilder;
+        g_variant_builder_init(&submenusBuilder, G_VARIANT_TYPE("a(taa{sv})"));
+        if (incremental) {
+            Q_FOREACH(quint64 tag, tags) {
+                // Gone submenus come with the change of their parent
+                UnityPlatformMenu* gplatformMenu = m_submenusWithTag.value(tag);
+                if (!gplatformMenu) continue;
+
+                g_variant_builder_add(&submenusBuilder, "(t@aa{sv})", tag, menuLayout(gplatformMenu, depth));
+            }
+        } else {
+            g_variant_builder_add(&submenusBuilder, "(t@aa{sv})", static_cast<quint64>(0), rootLayout(depth));
+            actions.clear();
+        }
+        GVariant *payload = g_variant_new("(a(taa{sv})@a(sbav))", &submenusBuilder, actionStates(actions));
+
+        const int fd = unity_menu_layout_buffer_new(payload, m_revision, incremental ? revision : 0);
+        if (fd < 0) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                                  "Failed to create the layout buffer");
+            return;
+        }
+
+        GUnixFDList *fdList = g_unix_fd_list_new_from_array(&fd, 1);
+        g_dbus_method_invocation_return_value_with_unix_fd_list(invocation, g_variant_new("(ht)", 0, m_revision), fdList);
+        g_object_unref(fdList);
+    }, invocation);
+}
+
+// Unexport the model
+void UnityGMenuModelExporter::unexportModels()
+{
+    GError *error = nullptr;
+    if (!m_connection) {
+        qCWarning(unityappmenu, "Failed to retreive session bus - %s", error ? error->message : "unknown error");
+        return;
+    }
+
+    if (m_threaded) {
+        UnityMenuExportThread::instance()->invokeSync([this]() { unexportModelsOnConnection(); });
+    } else {
+        unexportModelsOnConnection();
+    }
+    g_object_unref(m_connection);
+    m_connection = nullptr;
+}
+
+void UnityGMenuModelExporter::unexportModelsOnConnection()
+{
+    if (m_exportedModel != 0) {
+        g_dbus_connection_unexport_menu_model(m_connection, m_exportedModel);
+        m_exportedModel = 0;
+    }
+    if (m_exportedActions != 0) {
+        g_dbus_connection_unexport_action_group(m_connection, m_exportedActions);
+        m_exportedActions = 0;
+    }
+    Q_FOREACH(UnitySplitActionGroup *splitGroup, m_splitActionGroups) {
+        if (splitGroup->exportId != 0) {
+            g_dbus_connection_unexport_action_group(m_connection, splitGroup->exportId);
+            splitGroup->exportId = 0;
+        }
+    }
+    if (m_qtunityExtraHandler) {
+        m_qtunityExtraHandler->disconnect(m_connection);
+        delete m_qtunityExtraHandler;
+        m_qtunityExtraHandler = nullptr;
+    }
+}
+
+// Create a submenu for the given platform menu.
+// Returns a gmenuitem entry for the menu, which must be cleaned up using g_object_unref,
+// or null if the menu is hidden. If forItem is suplied, use it's label.
+GMenuItem *UnityGMenuModelExporter::createSubmenu(QPlatformMenu *platformMenu, UnityPlatformMenuItem *forItem,
+                                                  const QByteArray &prefix)
+{
+    UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
+    if (!gplatformMenu || !isSubmenuVisible(gplatformMenu, forItem)) return nullptr;
+
+    GMenu* menu = m_gmenusForMenus.value(gplatformMenu, nullptr);
+    if (menu) {
+        // Exported already, or built by buildSubmenusInParallel(): relinked as it is when its
+        // parent level is rebuilt, its own changes reload it in place, see timerEvent().
+        m_reusedSubmenuCount++;
+    } else {
+        const QByteArray key = subtreeHash(gplatformMenu, prefix, menuIndexPath(gplatformMenu));
+        menu = key.isEmpty() ? nullptr : UnitySharedMenuModels::instance()->lookup(key);
+        if (menu) {
+            // An identical submenu is exported already, only the actions need to be our own.
+            setSubmenuModel(gplatformMenu, menu);
+            linkSubmenuItems(gplatformMenu, menu);
+        } else {
+            menu = g_menu_new();
+            setSubmenuModel(gplatformMenu, menu);
+            g_object_unref(menu);
+
+            addSubmenuItems(gplatformMenu, menu);
+            shareSubmenuModel(gplatformMenu, menu, key);
+        }
+    }
+
+    QByteArray label;
+    bool enabled;
+    if (forItem) {
+        label = UnityPlatformMenuItem::get_text(forItem).toUtf8();
+        enabled = UnityPlatformMenuItem::get_enabled(forItem);
+    } else {
+        label = UnityPlatformMenu::get_text(gplatformMenu).toUtf8();
+        enabled = UnityPlatformMenu::get_enabled(gplatformMenu);
+    }
+
+    watchSubmenu(gplatformMenu);
+    if (!m_lastShown.contains(gplatformMenu)) {
+        touchSubmenu(gplatformMenu);
+    }
+
+    GMenuItem* gmenuItem = g_menu_item_new_submenu(label.constData(), G_MENU_MODEL(menu));
+    const quint64 tag = gplatformMenu->tag();
+    if (tag != 0) {
+        g_menu_item_set_attribute_value(gmenuItem, "qtunity-tag", g_variant_new_uint64 (tag));
+        m_submenusWithTag.insert(tag, gplatformMenu);
+    }
+
+    g_menu_item_set_attribute_value(gmenuItem, "submenu-enabled", g_variant_new_boolean(enabled));
+
+    UnitySplitActionGroup *splitGroup = m_splitActionGroups.value(m_actionPrefixes.value(gplatformMenu), nullptr);
+    if (splitGroup) {
+        g_menu_item_set_attribute_value(gmenuItem, "qtunity-actions",
+                                        g_variant_new("(so)", splitGroup->prefix.constData(), splitGroup->path.constData()));
+    }
+
+    return gmenuItem;
+}
+
+// Connect to the changes of a platform menu which need its gmenu to be reloaded.
+void UnityGMenuModelExporter::watchSubmenu(UnityPlatformMenu *gplatformMenu)
+{
+    Q_FOREACH(QPlatformMenuItem *childItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(childItem);
+        if (!gplatformMenuItem) continue;
+
+        // Sadly we don't have a better way to propagate a enabled change in a item-that-is-submenu
+        // than reseting the whole parent menu
+        if (gplatformMenuItem->menu()) {
+            connect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, gplatformMenu, &UnityPlatformMenu::structureChanged,
+                    Qt::UniqueConnection);
+        }
+        connect(gplatformMenuItem, &UnityPlatformMenuItem::visibleChanged, gplatformMenu, &UnityPlatformMenu::structureChanged,
+                Qt::UniqueConnection);
+        // Regroups the radio actions
+        connect(gplatformMenuItem, &UnityPlatformMenuItem::hasExclusiveGroupChanged, gplatformMenu,
+                &UnityPlatformMenu::structureChanged, Qt::UniqueConnection);
+    }
+
+    // Rebuilds watch the same menus again
+    if (m_watchedMenus.contains(gplatformMenu)) return;
+    m_watchedMenus.insert(gplatformMenu);
+
+    connect(gplatformMenu, &UnityPlatformMenu::structureChanged, this, [this, gplatformMenu]
+        {
+            m_mutationCount++;
+            if (!m_reloadMenuTimers.contains(gplatformMenu)) {
+                const int timerId = startTimer(0);
+                m_reloadMenuTimers.insert(gplatformMenu, timerId);
+            }
+        });
+
+    connect(gplatformMenu, &UnityPlatformMenu::destroyed, this, [this, gplatformMenu]
+        {
+            // Linked submenus are known by the tag of the menu they were built from
+            for (auto it = m_submenusWithTag.begin(); it != m_submenusWithTag.end();) {
+                if (it.value() == gplatformMenu) {
+                    it = m_submenusWithTag.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            GMenu *menu = m_gmenusForMenus.take(gplatformMenu);
+            if (menu) {
+                UnitySharedMenuModels::instance()->unref(menu);
+            }
+            m_parentMenus.remove(gplatformMenu);
+            m_subtreeHashes.remove(gplatformMenu);
+            m_watchedMenus.remove(gplatformMenu);
+            m_evictedMenus.remove(gplatformMenu);
+            m_lastShown.remove(gplatformMenu);
+            dropMenuPages(gplatformMenu);
+            m_searchIndex.removeMenu(gplatformMenu);
+            removeActionGroup(gplatformMenu);
+            auto timerIdIt = m_reloadMenuTimers.find(gplatformMenu);
+            if (timerIdIt != m_reloadMenuTimers.end()) {
+                killTimer(*timerIdIt);
+                m_reloadMenuTimers.erase(timerIdIt);
+            }
+        });
+}
+
+// Disconnect from a platform menu which is not exported any more.
+void UnityGMenuModelExporter::unwatchSubmenu(UnityPlatformMenu *gplatformMenu)
+{
+    m_watchedMenus.remove(gplatformMenu);
+    disconnect(gplatformMenu, &UnityPlatformMenu::structureChanged, this, 0);
+    disconnect(gplatformMenu, &UnityPlatformMenu::destroyed, this, 0);
+
+    auto timerIdIt = m_reloadMenuTimers.find(gplatformMenu);
+    if (timerIdIt != m_reloadMenuTimers.end()) {
+        killTimer(*timerIdIt);
+        m_reloadMenuTimers.erase(timerIdIt);
+    }
+}
+
+// Threads building the gmenus of the top level menus of a menubar, the gui thread included.
+// Opt in with QTUNITY_MENU_BUILD_THREADS, 0 for the number of cores. By default, or with 1,
+// createSubmenu() builds them in sequence.
+int UnityGMenuModelExporter::buildThreads()
+{
+    static const int threads = [] {
+        const QByteArray buildThreads = qgetenv("QTUNITY_MENU_BUILD_THREADS");
+        if (buildThreads.isEmpty()) return 1;
+        const int count = buildThreads.toInt();
+        return count == 0 ? QThread::idealThreadCount() : count;
+    }();
+    return qMax(threads, 1);
+}
+
+// Build the gmenus of top level menus on buildThreads() threads: the platform menus are
+// captured on the gui thread, their gmenus built from the snapshots in parallel, then linked
+// in one go. createSubmenu() then uses them as exported already. Hidden, paged and linked
+// menus, or ones identical to another, are left to createSubmenu().
+void UnityGMenuModelExporter::buildSubmenusInParallel(const QList<UnityPlatformMenu*> &menus)
+{
+    if (buildThreads() < 2) return;
+
+    QVector<QSharedPointer<UnityMenuSnapshot>> snapshots;
+    QSet<QByteArray> keys;
+    Q_FOREACH(UnityPlatformMenu *gplatformMenu, menus) {
+        if (!gplatformMenu || !isSubmenuVisible(gplatformMenu, nullptr) || m_gmenusForMenus.contains(gplatformMenu)) continue;
+
+        const QByteArray path = menuIndexPath(gplatformMenu);
+        const QByteArray key = subtreeHash(gplatformMenu, actionPrefix(gplatformMenu), path);
+        if (key.isEmpty() || keys.contains(key) || UnitySharedMenuModels::instance()->lookup(key)) continue;
+        keys.insert(key);
+        snapshots.append(captureSnapshot(gplatformMenu, actionPrefix(gplatformMenu), path));
+    }
+    if (snapshots.count() < 2) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool *pool = s_buildPool();
+    pool->setMaxThreadCount(buildThreads() - 1);
+    for (int i = 1; i < snapshots.count(); ++i) {
+        pool->start(new UnitySnapshotBuilder(snapshots.at(i).data()));
+    }
+    // The gui thread builds its share instead of only waiting
+    build_snapshot(*snapshots.first());
+    pool->waitForDone();
+
+    Q_FOREACH(const QSharedPointer<UnityMenuSnapshot> &snapshot, snapshots) {
+        commitSnapshot(*snapshot);
+    }
+    qCDebug(unityappmenuTiming, "%s: built %d top level menus on %d threads in %lld ms", qPrintable(m_menuPath),
+            snapshots.count(), qMin(buildThreads(), snapshots.count()), timer.elapsed());
+}
+
+// Capture what the gmenus of a platform menu and of its visible submenus are built from.
+// The prefix is the one of the top level menu, and the path the one of menuIndexPath(), as
+// m_parentMenus is only filled in by commitSnapshot().
+QSharedPointer<UnityMenuSnapshot> UnityGMenuModelExporter::captureSnapshot(UnityPlatformMenu *gplatformMenu,
+                                                                          const QByteArray &prefix, const QByteArray &path)
+{
+    QSharedPointer<UnityMenuSnapshot> snapshot(new UnityMenuSnapshot);
+    snapshot->menu = gplatformMenu;
+    snapshot->key = subtreeHash(gplatformMenu, prefix, path);
+
+    GMenu *menu = snapshot->key.isEmpty() ? nullptr : UnitySharedMenuModels::instance()->lookup(snapshot->key);
+    if (menu) {
+        // An identical submenu is exported already
+        snapshot->model = G_MENU(g_object_ref(menu));
+        snapshot->shared = true;
+        return snapshot;
+    }
+
+    snapshot->prefix = prefix;
+    snapshot->collapsible = UnityPlatformMenu::get_separatorsCollapsible(gplatformMenu);
+    const QHash<UnityPlatformMenuItem*, QByteArray> groups = radioGroups(gplatformMenu, snapshot->prefix, path);
+
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    for (int i = 0; i < menuItems.count(); ++i) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+        if (!gplatformMenuItem) continue;
+
+        UnityMenuSnapshotItem item;
+        item.item = gplatformMenuItem;
+        item.separator = UnityPlatformMenuItem::get_separator(gplatformMenuItem);
+        item.visible = UnityPlatformMenuItem::get_visible(gplatformMenuItem);
+        item.text = UnityPlatformMenuItem::get_text(gplatformMenuItem);
+        item.accel = UnityPlatformMenuItem::get_shortcut(gplatformMenuItem).toString(QKeySequence::NativeText).toUtf8();
+        item.radioGroup = groups.value(gplatformMenuItem);
+        item.submenu = static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu());
+        if (item.submenu) {
+            item.enabled = UnityPlatformMenuItem::get_enabled(gplatformMenuItem);
+            item.tag = item.submenu->tag();
+            if (item.visible && !item.separator) {
+                item.snapshot = captureSnapshot(item.submenu, prefix, submenuIndexPath(path, i));
+            }
+        }
+        snapshot->items.append(item);
+    }
+    return snapshot;
+}
+
+// Link the gmenu built for a snapshot, and fill in the exporter state of its items and
+// submenus, as createSubmenu() does for the gmenus it builds.
+void UnityGMenuModelExporter::commitSnapshot(UnityMenuSnapshot &snapshot)
+{
+    UnityPlatformMenu* gplatformMenu = snapshot.menu;
+    setSubmenuModel(gplatformMenu, snapshot.model);
+    if (snapshot.shared) {
+        linkSubmenuItems(gplatformMenu, snapshot.model);
+        return;
+    }
+    addRadioActions(gplatformMenu, snapshot.model);
+    Q_FOREACH(const UnityMenuSnapshotItem &item, snapshot.items) {
+        if (item.submenu) {
+            m_parentMenus.insert(item.submenu, gplatformMenu);
+            if (!item.snapshot) continue;
+
+            commitSnapshot(*item.snapshot);
+            watchSubmenu(item.submenu);
+            if (!m_lastShown.contains(item.submenu)) {
+                touchSubmenu(item.submenu);
+            }
+            if (item.tag != 0) {
+                m_submenusWithTag.insert(item.tag, item.submenu);
+            }
+        } else if (item.visible && !item.separator && item.radioGroup.isEmpty()) {
+            addAction(item.action, item.item, snapshot.model);
+        }
+    }
+
+    shareSubmenuModel(gplatformMenu, snapshot.model, snapshot.key);
+
+    // Once the actions are created, see indexMenuItems()
+    const QStringList path = submenuPath(gplatformMenu);
+    m_searchIndex.removeMenu(gplatformMenu);
+    Q_FOREACH(const UnityMenuSnapshotItem &item, snapshot.items) {
+        if (item.submenu || item.separator || !item.visible) continue;
+
+        if (!item.radioGroup.isEmpty()) {
+            m_searchIndex.insert(gplatformMenu, item.item, item.radioGroup, item.action, item.text, path);
+        } else {
+            m_searchIndex.insert(gplatformMenu, item.item, item.action, QByteArray(), item.text, path);
+        }
+    }
+}
+
+// Register the gmenu built for a platform menu as shareable under its content hash, with the
+// submenus it links. Its submenus have to be shareable too, for their own submenus to be known.
+void UnityGMenuModelExporter::shareSubmenuModel(UnityPlatformMenu *gplatformMenu, GMenu *menu, const QByteArray &key)
 {
-    UnityPlatformMenu* gplatformMenu = m_submenusWithTag.value(tag);
-    if (!gplatformMenu) {
-        qWarning() << "Got an aboutToShow call with an unknown tag";
-        return;
-    }
+    if (key.isEmpty() || UnitySharedMenuModels::instance()->lookup(key)) return;
 
-    gplatformMenu->aboutToShow();
+    // Depth first, in the order addSubmenuItems() creates them, like collectSubmenus()
+    QVector<QPair<GMenu*, quint64>> submenus;
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+        if (!gplatformMenuItem || UnityPlatformMenuItem::get_separator(gplatformMenuItem)) continue;
+
+        UnityPlatformMenu* gplatformSubmenu = static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu());
+        if (!gplatformSubmenu || !isSubmenuVisible(gplatformSubmenu, gplatformMenuItem)) continue;
+
+        GMenu *submenu = m_gmenusForMenus.value(gplatformSubmenu, nullptr);
+        QVector<QPair<GMenu*, quint64>> linkedSubmenus;
+        if (!submenu || !UnitySharedMenuModels::instance()->submenus(submenu, linkedSubmenus)) return;
+
+        submenus.append(qMakePair(submenu, static_cast<quint64>(gplatformSubmenu->tag())));
+        submenus += linkedSubmenus;
+    }
+    UnitySharedMenuModels::instance()->insert(key, menu, submenus);
 }
 
-// Unexport the model
-void UnityGMenuModelExporter::unexportModels()
+// Fill in the exporter state for a platform menu linking the gmenu of an identical
+// submenu: the gmenus are shared, but actions and tags belong to each exporter.
+void UnityGMenuModelExporter::linkSubmenuItems(UnityPlatformMenu *gplatformMenu, GMenu *menu)
 {
-    GError *error = nullptr;
-    if (!m_connection) {
-        qCWarning(unityappmenu, "Failed to retreive session bus - %s", error ? error->message : "unknown error");
+    QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> submenus;
+    collectSubmenus(gplatformMenu, submenus);
+    QVector<QPair<GMenu*, quint64>> linkedSubmenus;
+    const bool shared = UnitySharedMenuModels::instance()->submenus(menu, linkedSubmenus);
+
+    addSubmenuActions(gplatformMenu, menu);
+
+    if (!shared || submenus.count() != linkedSubmenus.count()) {
+        qCWarning(unityappmenu, "Linked menu model does not match its menu");
         return;
     }
 
-    if (m_exportedModel != 0) {
-        g_dbus_connection_unexport_menu_model(m_connection, m_exportedModel);
-        m_exportedModel = 0;
-    }
-    if (m_exportedActions != 0) {
-        g_dbus_connection_unexport_action_group(m_connection, m_exportedActions);
-        m_exportedActions = 0;
-    }
-    if (m_qtunityExtraHandler) {
-        m_qtunityExtraHandler->disconnect(m_connection);
-        delete m_qtunityExtraHandler;
-        m_qtunityExtraHandler = nullptr;
+    for (int i = 0; i < submenus.count(); ++i) {
+        UnityPlatformMenu* gplatformSubmenu = submenus[i].first;
+        GMenu* submenu = linkedSubmenus[i].first;
+        const quint64 linkedTag = linkedSubmenus[i].second;
+
+        setSubmenuModel(gplatformSubmenu, submenu);
+        m_parentMenus.insert(gplatformSubmenu, submenus[i].second);
+        // The linked items carry the tags of the menus they were built from, while our own
+        // tag comes with layouts and change journals, see submenuLayout() and recordChange().
+        if (linkedTag != 0) {
+            m_submenusWithTag.insert(linkedTag, gplatformSubmenu);
+        }
+        if (gplatformSubmenu->tag() != 0) {
+            m_submenusWithTag.insert(gplatformSubmenu->tag(), gplatformSubmenu);
+        }
+        watchSubmenu(gplatformSubmenu);
+        addSubmenuActions(gplatformSubmenu, submenu);
     }
-    g_object_unref(m_connection);
-    m_connection = nullptr;
 }
 
-// Create a submenu for the given platform menu.
-// Returns a gmenuitem entry for the menu, which must be cleaned up using g_object_unref.
-// If forItem is suplied, use it's label.
-GMenuItem *UnityGMenuModelExporter::createSubmenu(QPlatformMenu *platformMenu, UnityPlatformMenuItem *forItem)
+// Add the actions of the items of a platform menu, without creating their gmenu items.
+void UnityGMenuModelExporter::addSubmenuActions(UnityPlatformMenu *gplatformMenu, GMenu *menu)
 {
-    UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(platformMenu);
-    if (!gplatformMenu) return nullptr;
-    GMenu* menu = g_menu_new();
+    addRadioActions(gplatformMenu, menu);
+    const QByteArray prefix = actionPrefix(gplatformMenu);
 
-    m_gmenusForMenus.insert(gplatformMenu, menu);
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+        if (!gplatformMenuItem || gplatformMenuItem->menu()) continue;
+        if (m_radioGroups.contains(gplatformMenuItem)) continue;
 
-    QByteArray label;
-    bool enabled;
-    if (forItem) {
-        label = UnityPlatformMenuItem::get_text(forItem).toUtf8();
-        enabled = UnityPlatformMenuItem::get_enabled(forItem);
-    } else {
-        label = UnityPlatformMenu::get_text(gplatformMenu).toUtf8();
-        enabled = UnityPlatformMenu::get_enabled(gplatformMenu);
+        if (UnityPlatformMenuItem::get_separator(gplatformMenuItem) ||
+                !UnityPlatformMenuItem::get_visible(gplatformMenuItem)) continue;
+
+        QByteArray actionLabel(getActionString(UnityPlatformMenuItem::get_text(gplatformMenuItem)).toUtf8());
+        addAction(prefix + '.' + actionLabel, gplatformMenuItem, menu);
     }
 
-    addSubmenuItems(gplatformMenu, menu);
+    indexMenuItems(gplatformMenu, 0, gplatformMenu->menuItems().count());
+}
 
-    Q_FOREACH(QPlatformMenuItem *childItem, gplatformMenu->menuItems()) {
-        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(childItem);
-        if (!gplatformMenuItem) continue;
+// Add a platform menu's items to the given gmenu.
+void UnityGMenuModelExporter::addSubmenuItems(UnityPlatformMenu* gplatformMenu, GMenu* menu)
+{
+    addRadioActions(gplatformMenu, menu);
+    addMenuPage(gplatformMenu, menu, 0);
+}
 
-        // Sadly we don't have a better way to propagate a enabled change in a item-that-is-submenu
-        // than reseting the whole parent menu
-        if (gplatformMenuItem->menu()) {
-            connect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, gplatformMenu, &UnityPlatformMenu::structureChanged);
+// Add a platform menu's items from the given index on to the given gmenu.
+// The items are inserted into menus sections, split by the menu separators.
+// Paged menus stop after a page, which is followed by a continuation submenu for the next one.
+void UnityGMenuModelExporter::addMenuPage(UnityPlatformMenu* gplatformMenu, GMenu* menu, int first)
+{
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    const int size = pageSize(gplatformMenu);
+    first = qMin(first, menuItems.count());
+    const int last = size > 0 && menuItems.count() - first > size ? first + size : menuItems.count();
+
+    const QByteArray prefix = actionPrefix(gplatformMenu);
+
+    for (int i = first; i < last; ++i) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+        if (gplatformMenuItem && gplatformMenuItem->menu()) {
+            m_parentMenus.insert(static_cast<UnityPlatformMenu*>(gplatformMenuItem->menu()), gplatformMenu);
         }
-        connect(gplatformMenuItem, &UnityPlatformMenuItem::visibleChanged, gplatformMenu, &UnityPlatformMenu::structureChanged);
     }
 
-    GMenuItem* gmenuItem = g_menu_item_new_submenu(label.constData(), G_MENU_MODEL(menu));
-    const quint64 tag = gplatformMenu->tag();
-    if (tag != 0) {
-        g_menu_item_set_attribute_value(gmenuItem, "qtunity-tag", g_variant_new_uint64 (tag));
-        m_submenusWithTag.insert(gplatformMenu->tag(), gplatformMenu);
+    const QVector<QPair<int, int>> sections = menuSections(gplatformMenu, first, last);
+    for (int i = sections.first().first; i < sections.first().second; ++i) {
+        processItemForGMenu(menuItems.at(i), menu, prefix);
+    }
+    for (int i = 1; i < sections.count(); ++i) {
+        GMenuItem* section = createSection(menuItems.constBegin() + sections.at(i).first,
+                                           menuItems.constBegin() + sections.at(i).second, menu, prefix);
+        g_menu_append_item(menu, section);
+        g_object_unref(section);
     }
-    g_object_unref(menu);
 
-    g_menu_item_set_attribute_value(gmenuItem, "submenu-enabled", g_variant_new_boolean(enabled));
+    if (last < menuItems.count()) {
+        GMenuItem* continuation = createContinuation(gplatformMenu, last);
+        g_menu_append_item(menu, continuation);
+        g_object_unref(continuation);
+    }
 
-    connect(gplatformMenu, &UnityPlatformMenu::structureChanged, this, [this, gplatformMenu]
-        {
-            if (!m_reloadMenuTimers.contains(gplatformMenu)) {
-                const int timerId = startTimer(0);
-                m_reloadMenuTimers.insert(gplatformMenu, timerId);
-            }
-        });
+    indexMenuItems(gplatformMenu, first, last);
+}
 
-    connect(gplatformMenu, &UnityPlatformMenu::destroyed, this, [this, tag, gplatformMenu]
-        {
-            m_submenusWithTag.remove(tag);
-            m_gmenusForMenus.remove(gplatformMenu);
-            auto timerIdIt = m_reloadMenuTimers.find(gplatformMenu);
-            if (timerIdIt != m_reloadMenuTimers.end()) {
-                killTimer(*timerIdIt);
-                m_reloadMenuTimers.erase(timerIdIt);
-            }
-        });
+// The item ranges of a platform menu from first to last, as split by split_sections().
+QVector<QPair<int, int>> UnityGMenuModelExporter::menuSections(UnityPlatformMenu* gplatformMenu, int first, int last)
+{
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    auto item = [&menuItems](int i) { return static_cast<UnityPlatformMenuItem*>(menuItems.at(i)); };
+    return split_sections(first, last, UnityPlatformMenu::get_separatorsCollapsible(gplatformMenu),
+        [&item](int i) { return item(i) && UnityPlatformMenuItem::get_separator(item(i)); },
+        [&item](int i) { return item(i) && UnityPlatformMenuItem::get_visible(item(i)); });
+}
 
+// Create the continuation submenu of a paged menu, standing for its items from the given index on.
+// Its content is only built once the shell is about to show it, see revealMenuPage().
+// Returned GMenuItem must be cleaned up using g_object_unref
+GMenuItem *UnityGMenuModelExporter::createContinuation(UnityPlatformMenu *gplatformMenu, int first)
+{
+    // Platform menu tags are pointers, odd tags can't clash with them
+    const quint64 tag = (++s_pageCount << 1) | 1;
+    GMenu *pageMenu = g_menu_new();
+    m_menuPages.insert(tag, UnityMenuPage{gplatformMenu, pageMenu, first, false});
+
+    const QByteArray label(QCoreApplication::translate("UnityGMenuModelExporter", "More").toUtf8());
+    GMenuItem* gmenuItem = g_menu_item_new_submenu(label.constData(), G_MENU_MODEL(pageMenu));
+    g_menu_item_set_attribute_value(gmenuItem, "qtunity-tag", g_variant_new_uint64(tag));
+    g_menu_item_set_attribute_value(gmenuItem, "submenu-enabled", g_variant_new_boolean(TRUE));
     return gmenuItem;
 }
 
-// Add a platform menu's items to the given gmenu.
-// The items are inserted into menus sections, split by the menu separators.
-void UnityGMenuModelExporter::addSubmenuItems(UnityPlatformMenu* gplatformMenu, GMenu* menu)
+// Build the next page of a paged menu, when its continuation submenu is about to be shown.
+void UnityGMenuModelExporter::revealMenuPage(quint64 tag)
 {
-    auto iter = gplatformMenu->menuItems().begin();
-    auto lastSectionStart = iter;
-    // Iterate through all the menu items adding sections when a separator is found.
-    for (; iter != gplatformMenu->menuItems().end(); ++iter) {
-        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(*iter);
-        if (!gplatformMenuItem) continue;
+    auto it = m_menuPages.find(tag);
+    if (it == m_menuPages.end() || it->revealed) return;
+    it->revealed = true;
+
+    // Adding the page may add the next continuation, and invalidate it
+    UnityPlatformMenu* gplatformMenu = it->menu;
+    GMenu *pageMenu = it->model;
+    const int first = it->first;
+
+    GMenu *content = g_menu_new();
+    addMenuPage(gplatformMenu, content, first);
+    // The state of the items of the pages goes along with the one of the menu
+    moveMenuItemsState(content, m_gmenusForMenus.value(gplatformMenu, m_gmainMenu));
+    setMenuItems(pageMenu, content);
+    g_object_unref(content);
+    recordChange(tag, QByteArray());
+}
 
-        // don't add a section until we have separator
-        if (UnityPlatformMenuItem::get_separator(gplatformMenuItem)) {
-            if (lastSectionStart != gplatformMenu->menuItems().begin()) {
-                GMenuItem* section = createSection(lastSectionStart, iter);
-                g_menu_append_item(menu, section);
-                g_object_unref(section);
-            }
-            lastSectionStart = iter + 1;
-        } else if (lastSectionStart == gplatformMenu->menuItems().begin()) {
-            processItemForGMenu(gplatformMenuItem, menu);
+// Drop the continuation submenus of a platform menu, or of all menus.
+void UnityGMenuModelExporter::dropMenuPages(UnityPlatformMenu *gplatformMenu)
+{
+    for (auto it = m_menuPages.begin(); it != m_menuPages.end();) {
+        if (!gplatformMenu || it->menu == gplatformMenu) {
+            g_object_unref(it->model);
+            it = m_menuPages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Add the items of a platform menu in [first, last) to the search index, once their actions are created.
+// Indexing from the first item replaces the entries of the menu, its former items included.
+void UnityGMenuModelExporter::indexMenuItems(UnityPlatformMenu *gplatformMenu, int first, int last)
+{
+    const QStringList path = submenuPath(gplatformMenu);
+    const QByteArray prefix = actionPrefix(gplatformMenu);
+    if (first == 0) {
+        m_searchIndex.removeMenu(gplatformMenu);
+    }
+
+    const QList<QPlatformMenuItem*> menuItems = gplatformMenu->menuItems();
+    for (int i = first; i < last; ++i) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(menuItems.at(i));
+        if (!gplatformMenuItem || gplatformMenuItem->menu()) continue;
+
+        if (UnityPlatformMenuItem::get_separator(gplatformMenuItem) ||
+                !UnityPlatformMenuItem::get_visible(gplatformMenuItem)) continue;
+
+        const QString label = UnityPlatformMenuItem::get_text(gplatformMenuItem);
+        const QByteArray actionLabel(getActionString(label).toUtf8());
+        const QByteArray radioGroup = m_radioGroups.value(gplatformMenuItem);
+        if (!radioGroup.isEmpty()) {
+            m_searchIndex.insert(gplatformMenu, gplatformMenuItem, radioGroup, actionLabel, label, path);
+        } else {
+            m_searchIndex.insert(gplatformMenu, gplatformMenuItem, prefix + '.' + actionLabel, QByteArray(), label, path);
         }
     }
+}
 
-    // Add the last section
-    if (lastSectionStart != gplatformMenu->menuItems().begin() &&
-            lastSectionStart != gplatformMenu->menuItems().end()) {
-        GMenuItem* gsectionItem = createSection(lastSectionStart, gplatformMenu->menuItems().end());
-        g_menu_append_item(menu, gsectionItem);
-        g_object_unref(gsectionItem);
+// The labels of a platform menu and of its parents, starting from the top level.
+QStringList UnityGMenuModelExporter::submenuPath(UnityPlatformMenu *gplatformMenu) const
+{
+    QStringList path;
+    for (; gplatformMenu; gplatformMenu = m_parentMenus.value(gplatformMenu, nullptr)) {
+        const QString text = UnityPlatformMenu::get_text(gplatformMenu);
+        if (!text.isEmpty()) {
+            path.prepend(text);
+        }
     }
+    return path;
 }
 
 // Create and return a gmenu item for the given platform menu item.
 // Returned GMenuItem must be cleaned up using g_object_unref
-GMenuItem *UnityGMenuModelExporter::createMenuItem(QPlatformMenuItem *platformMenuItem, GMenu *parentMenu)
+GMenuItem *UnityGMenuModelExporter::createMenuItem(QPlatformMenuItem *platformMenuItem, GMenu *parentMenu, const QByteArray &prefix)
 {
     UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
     if (!gplatformMenuItem) return nullptr;
@@ -389,20 +2490,31 @@ GMenuItem *UnityGMenuModelExporter::createMenuItem(QPlatformMenuItem *platformMe
 
     GMenuItem* gmenuItem = g_menu_item_new(label.constData(), nullptr);
     g_menu_item_set_attribute(gmenuItem, "accel", "s", shortcut.constData());
-    g_menu_item_set_detailed_action(gmenuItem, ("unity." + actionLabel).constData());
 
-    addAction(actionLabel, gplatformMenuItem, parentMenu);
+    const QByteArray radioGroup = m_radioGroups.value(gplatformMenuItem);
+    if (!radioGroup.isEmpty()) {
+        // The action of the group was added by addRadioActions()
+        g_menu_item_set_action_and_target_value(gmenuItem, radioGroup.constData(),
+                                                g_variant_new_string(actionLabel.constData()));
+    } else {
+        const QByteArray name(prefix + '.' + actionLabel);
+        g_menu_item_set_detailed_action(gmenuItem, name.constData());
+        addAction(name, gplatformMenuItem, parentMenu);
+    }
     return gmenuItem;
 }
 
 // Create a menu section for a section of separated menu items.
+// The actions of the items belong to the parent menu, so they go along with it.
 // Returned GMenuItem must be cleaned up using g_object_unref
-GMenuItem *UnityGMenuModelExporter::createSection(QList<QPlatformMenuItem *>::const_iterator iter, QList<QPlatformMenuItem *>::const_iterator end)
+GMenuItem *UnityGMenuModelExporter::createSection(QList<QPlatformMenuItem *>::const_iterator iter, QList<QPlatformMenuItem *>::const_iterator end,
+                                                   GMenu *parentMenu, const QByteArray &prefix)
 {
     GMenu* gsectionMenu = g_menu_new();
     for (; iter != end; ++iter) {
-        processItemForGMenu(*iter, gsectionMenu);
+        processItemForGMenu(*iter, gsectionMenu, prefix);
     }
+    moveMenuItemsState(gsectionMenu, parentMenu);
     GMenuItem* gsectionItem = g_menu_item_new_section("", G_MENU_MODEL(gsectionMenu));
     g_object_unref(gsectionMenu);
     return gsectionItem;
@@ -410,13 +2522,13 @@ GMenuItem *UnityGMenuModelExporter::createSection(QList<QPlatformMenuItem *>::co
 
 // Add the given platform menu item to the menu.
 // If it has an attached submenu, then create and add the submenu.
-void UnityGMenuModelExporter::processItemForGMenu(QPlatformMenuItem *platformMenuItem, GMenu *gmenu)
+void UnityGMenuModelExporter::processItemForGMenu(QPlatformMenuItem *platformMenuItem, GMenu *gmenu, const QByteArray &prefix)
 {
     UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
     if (!gplatformMenuItem) return;
 
-    GMenuItem* gmenuItem = gplatformMenuItem->menu() ? createSubmenu(gplatformMenuItem->menu(), gplatformMenuItem) :
-                                                       createMenuItem(gplatformMenuItem, gmenu);
+    GMenuItem* gmenuItem = gplatformMenuItem->menu() ? createSubmenu(gplatformMenuItem->menu(), gplatformMenuItem, prefix) :
+                                                       createMenuItem(gplatformMenuItem, gmenu, prefix);
     if (gmenuItem) {
         g_menu_append_item(gmenu, gmenuItem);
         g_object_unref(gmenuItem);
@@ -433,43 +2545,474 @@ void UnityGMenuModelExporter::addAction(const QByteArray &name, UnityPlatformMen
     QVector<QMetaObject::Connection> &propertyConnections = m_propertyConnections[parentMenu];
 
     if (actions.contains(name)) {
-        g_action_map_remove_action(G_ACTION_MAP(m_gactionGroup), name.constData());
+        removeAction(name);
         actions.remove(name);
     }
 
-    bool checkable = UnityPlatformMenuItem::get_checkable(gplatformMenuItem);
+    UnityMenuAction menuAction;
+    menuAction.item = gplatformMenuItem;
+    menuAction.checkable = UnityPlatformMenuItem::get_checkable(gplatformMenuItem);
+    menuAction.checked = UnityPlatformMenuItem::get_checked(gplatformMenuItem);
+    menuAction.enabled = UnityPlatformMenuItem::get_enabled(gplatformMenuItem);
+
+    // Checked and enabled updates
+    std::function<void()> update = [this, name]() {
+        scheduleActionUpdate(name);
+    };
+    // save the connections to disconnect in UnityGMenuModelExporter::clear()
+    if (menuAction.checkable) {
+        propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::checkedChanged, this, update);
+    }
+    propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, this, update);
+
+    actions.insert(name);
+    m_menuActions.insert(name, menuAction);
+    insertAction(name, nullptr, menuAction.enabled,
+                 menuAction.checkable ? g_variant_new_boolean(menuAction.checked) : nullptr);
+}
+
+// The prefix of the radio actions of a platform menu. They are named after the index path
+// of the menu rather than the menu itself, so identical menus in other windows get the same
+// names and can share their gmenus, while the groups of other menus of the action group
+// get other names.
+QByteArray UnityGMenuModelExporter::radioGroupPrefix(const QByteArray &prefix, const QByteArray &path)
+{
+    // item actions can't contain dots, so this can't clash with them
+    return prefix + ".radio." + path + '.';
+}
+
+// Index path of the submenu of the item at an index of a menu, from the path of the menu.
+QByteArray UnityGMenuModelExporter::submenuIndexPath(const QByteArray &path, int index)
+{
+    // Action names only take alphanumerics, dashes and dots
+    return path + '-' + QByteArray::number(index);
+}
+
+// Index path of an exported platform menu: the position of its top level menu, followed by
+// the position of the item of each submenu leading to it.
+QByteArray UnityGMenuModelExporter::menuIndexPath(UnityPlatformMenu *gplatformMenu) const
+{
+    UnityPlatformMenu *parent = m_parentMenus.value(gplatformMenu, nullptr);
+    if (!parent) return QByteArray::number(topLevelIndex(gplatformMenu));
+
+    const QList<QPlatformMenuItem*> menuItems = parent->menuItems();
+    int index = 0;
+    while (index < menuItems.count() && (!menuItems.at(index) || menuItems.at(index)->menu() != gplatformMenu)) {
+        ++index;
+    }
+    return submenuIndexPath(menuIndexPath(parent), index);
+}
+
+int UnityGMenuModelExporter::topLevelIndex(UnityPlatformMenu *) const
+{
+    return 0;
+}
 
-    GSimpleAction* action = nullptr;
-    if (checkable) {
-        bool checked = UnityPlatformMenuItem::get_checked(gplatformMenuItem);
-        action = g_simple_action_new_stateful(name.constData(), nullptr, g_variant_new_boolean(checked));
+// Whether the radio actions of a platform menu or of its submenus are named after another
+// position than the one they have now, see timerEvent().
+bool UnityGMenuModelExporter::hasMovedRadioGroups(UnityPlatformMenu *gplatformMenu)
+{
+    QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> submenus;
+    submenus.append(qMakePair(gplatformMenu, m_parentMenus.value(gplatformMenu, nullptr)));
+    collectSubmenus(gplatformMenu, submenus);
+
+    for (int i = 0; i < submenus.count(); ++i) {
+        UnityPlatformMenu *submenu = submenus[i].first;
+        Q_FOREACH(QPlatformMenuItem *platformMenuItem, submenu->menuItems()) {
+            const QByteArray name = m_radioGroups.value(static_cast<UnityPlatformMenuItem*>(platformMenuItem));
+            if (name.isEmpty()) continue;
+
+            // The groups of a menu are named alike
+            if (!name.startsWith(radioGroupPrefix(actionPrefix(submenu), menuIndexPath(submenu)))) return true;
+            break;
+        }
+    }
+    return false;
+}
 
-        std::function<void(bool)> updateChecked = [gplatformMenuItem, action](bool checked) {
-            auto type = g_action_get_state_type(G_ACTION(action));
-            if (type && g_variant_type_equal(type, G_VARIANT_TYPE_BOOLEAN)) {
-                g_simple_action_set_state(action, g_variant_new_boolean(checked ? TRUE : FALSE));
+// Group the runs of exclusive checkable items of a platform menu. Each group is exported
+// as one radio action with a string state holding the target of the checked item, instead
+// of a boolean action per item. Returns the radio action name of every grouped item.
+// The path is the one of menuIndexPath(), see radioGroupPrefix().
+QHash<UnityPlatformMenuItem*, QByteArray> UnityGMenuModelExporter::radioGroups(UnityPlatformMenu *gplatformMenu,
+                                                                               const QByteArray &prefix,
+                                                                               const QByteArray &path) const
+{
+    QHash<UnityPlatformMenuItem*, QByteArray> groups;
+    QList<UnityPlatformMenuItem*> run;
+    const QByteArray groupPrefix = radioGroupPrefix(prefix, path);
+    int groupCount = 0;
+
+    auto addGroup = [&groups, &run, &groupPrefix, &groupCount]() {
+        // The items need distinct targets, and to agree on the enabled state of the action.
+        bool groupable = run.count() > 1;
+        QSet<QString> targets;
+        Q_FOREACH(UnityPlatformMenuItem *gplatformMenuItem, run) {
+            const QString target = getActionString(UnityPlatformMenuItem::get_text(gplatformMenuItem));
+            groupable = groupable && !targets.contains(target) &&
+                UnityPlatformMenuItem::get_enabled(gplatformMenuItem) == UnityPlatformMenuItem::get_enabled(run.first());
+            targets.insert(target);
+        }
+        if (groupable) {
+            const QByteArray name(groupPrefix + QByteArray::number(groupCount++));
+            Q_FOREACH(UnityPlatformMenuItem *gplatformMenuItem, run) {
+                groups.insert(gplatformMenuItem, name);
             }
+        }
+        run.clear();
+    };
+
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+        if (!gplatformMenuItem) continue;
+
+        if (UnityPlatformMenuItem::get_hasExclusiveGroup(gplatformMenuItem) &&
+                UnityPlatformMenuItem::get_checkable(gplatformMenuItem) &&
+                !UnityPlatformMenuItem::get_separator(gplatformMenuItem) &&
+                !gplatformMenuItem->menu()) {
+            run.append(gplatformMenuItem);
+        } else {
+            addGroup();
+        }
+    }
+    addGroup();
+
+    return groups;
+}
+
+// Create the radio actions for the exclusive groups of a platform menu.
+void UnityGMenuModelExporter::addRadioActions(UnityPlatformMenu *gplatformMenu, GMenu *menu)
+{
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        m_radioGroups.remove(static_cast<UnityPlatformMenuItem*>(platformMenuItem));
+    }
+
+    const QHash<UnityPlatformMenuItem*, QByteArray> groups = radioGroups(gplatformMenu, actionPrefix(gplatformMenu),
+                                                                         menuIndexPath(gplatformMenu));
+    if (groups.isEmpty()) return;
+
+    QSet<QByteArray> &actions = m_actions[menu];
+    QVector<QMetaObject::Connection> &propertyConnections = m_propertyConnections[menu];
+    QList<QByteArray> createdActions;
+
+    Q_FOREACH(QPlatformMenuItem *platformMenuItem, gplatformMenu->menuItems()) {
+        UnityPlatformMenuItem* gplatformMenuItem = static_cast<UnityPlatformMenuItem*>(platformMenuItem);
+        const QByteArray name = groups.value(gplatformMenuItem);
+        if (name.isEmpty()) continue;
+
+        if (!createdActions.contains(name)) {
+            // First item of the group
+            createdActions.append(name);
+            removeAction(name);
+
+            UnityMenuAction menuAction;
+            menuAction.radio = true;
+            menuAction.menu = gplatformMenu;
+            menuAction.enabled = UnityPlatformMenuItem::get_enabled(gplatformMenuItem);
+            m_menuActions.insert(name, menuAction);
+            actions.insert(name);
+        }
+        m_radioGroups.insert(gplatformMenuItem, name);
+
+        UnityMenuAction &menuAction = m_menuActions[name];
+        const QByteArray target(getActionString(UnityPlatformMenuItem::get_text(gplatformMenuItem)).toUtf8());
+        menuAction.targets.insert(target, gplatformMenuItem);
+        if (UnityPlatformMenuItem::get_checked(gplatformMenuItem)) {
+            menuAction.checkedTarget = target;
+        }
+
+        disconnect(gplatformMenuItem, &UnityPlatformMenuItem::checkedChanged, this, 0);
+        disconnect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, this, 0);
+
+        std::function<void()> update = [this, name]() {
+            scheduleActionUpdate(name);
         };
-        // save the connection to disconnect in UnityGMenuModelExporter::clear()
-        propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::checkedChanged, this, updateChecked);
-    } else {
-        action = g_simple_action_new(name.constData(), nullptr);
+        // save the connections to disconnect in UnityGMenuModelExporter::clear()
+        propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::checkedChanged, this, update);
+        propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, this, update);
     }
 
-    // Enabled update
-    std::function<void(bool)> updateEnabled = [gplatformMenuItem, action](bool enabled) {
-        GValue value = G_VALUE_INIT;
-        g_value_init (&value, G_TYPE_BOOLEAN);
-        g_value_set_boolean(&value, enabled ? TRUE : FALSE);
-        g_object_set_property(G_OBJECT(action), "enabled", &value);
-    };
-    updateEnabled(UnityPlatformMenuItem::get_enabled(gplatformMenuItem));
-    // save the connection to disconnect in UnityGMenuModelExporter::clear()
-    propertyConnections << connect(gplatformMenuItem, &UnityPlatformMenuItem::enabledChanged, this, updateEnabled);
+    // The actions are created once the checked target of their group is known
+    Q_FOREACH(const QByteArray &name, createdActions) {
+        const UnityMenuAction &menuAction = m_menuActions[name];
+        insertAction(name, G_VARIANT_TYPE_STRING, menuAction.enabled,
+                     g_variant_new_string(menuAction.checkedTarget.constData()));
+    }
+}
+
+// Add an action to the exported action group. Takes the floating state reference, if any.
+// parameterType must be a static type.
+void UnityGMenuModelExporter::insertAction(const QByteArray &name, const GVariantType *parameterType, bool enabled, GVariant *state)
+{
+    if (state) {
+        g_variant_ref_sink(state);
+    }
 
-    g_signal_connect(action, "activate", G_CALLBACK(activate_cb), gplatformMenuItem);
+    QByteArray actionName;
+    UnityMenuActionGroup *actionGroup = this->actionGroup(name, &actionName);
+    if (!actionGroup) {
+        if (state) {
+            g_variant_unref(state);
+        }
+        return;
+    }
+    g_object_ref(actionGroup);
+    runInExportContext([actionGroup, actionName, parameterType, enabled, state]() {
+        unity_menu_action_group_add(actionGroup, actionName.constData(), parameterType, enabled, state);
+        if (state) {
+            g_variant_unref(state);
+        }
+        g_object_unref(actionGroup);
+    });
+}
 
-    actions.insert(name);
-    g_action_map_add_action(G_ACTION_MAP(m_gactionGroup), G_ACTION(action));
-    g_object_unref(action);
+void UnityGMenuModelExporter::removeAction(const QByteArray &name)
+{
+    m_menuActions.remove(name);
+    m_pendingActionUpdates.remove(name);
+
+    QByteArray actionName;
+    UnityMenuActionGroup *actionGroup = this->actionGroup(name, &actionName);
+    // The group of a removed top level menu went along with its actions
+    if (!actionGroup) return;
+    g_object_ref(actionGroup);
+    runInExportContext([actionGroup, actionName]() {
+        unity_menu_action_group_remove(actionGroup, actionName.constData());
+        g_object_unref(actionGroup);
+    });
+}
+
+// Activate the menu item of an action. Called from the context the actions are exported on.
+void UnityGMenuModelExporter::activateAction(const QByteArray &name, GVariant *parameter)
+{
+    QByteArray target;
+    bool hasState = false;
+    bool state = false;
+    if (parameter && g_variant_is_of_type(parameter, G_VARIANT_TYPE_STRING)) {
+        target = g_variant_get_string(parameter, nullptr);
+    } else if (parameter && g_variant_is_of_type(parameter, G_VARIANT_TYPE_BOOLEAN)) {
+        hasState = true;
+        state = g_variant_get_boolean(parameter);
+    }
+
+    runInGuiThread([this, name, target, hasState, state]() {
+        auto it = m_menuActions.constFind(name);
+        if (it == m_menuActions.constEnd()) return;
+
+        UnityPlatformMenuItem *gplatformMenuItem = nullptr;
+        if (it->radio) {
+            qCDebug(unityappmenu, "Activate menu action '%s' with target '%s'", name.constData(), target.constData());
+            gplatformMenuItem = it->targets.value(target).data();
+        } else if (!hasState || state != it->checked) {
+            gplatformMenuItem = it->item.data();
+        }
+        if (gplatformMenuItem) {
+            UnityMenuTrace::record(UnityMenuTrace::Activate, gplatformMenuItem);
+            gplatformMenuItem->activated();
+        }
+    });
+}
+
+// Queue an update of an action from the state of its menu item.
+// Apps often flip the state of many actions back and forth while updating their ui, so
+// the changes are merged until the next event loop iteration and only the net changes
+// reach the exported action group.
+void UnityGMenuModelExporter::scheduleActionUpdate(const QByteArray &name)
+{
+    m_mutationCount++;
+    m_pendingActionUpdates.insert(name);
+    if (!m_actionUpdateTimer.isActive()) {
+        m_actionUpdateTimer.start();
+    }
+}
+
+void UnityGMenuModelExporter::flushActionUpdates()
+{
+    const QSet<QByteArray> pendingActionUpdates = m_pendingActionUpdates;
+    m_pendingActionUpdates.clear();
+
+    Q_FOREACH(const QByteArray &name, pendingActionUpdates) {
+        auto it = m_menuActions.find(name);
+        if (it == m_menuActions.end()) continue;
+
+        if (it->radio) {
+            updateRadioAction(name, *it);
+        } else {
+            updateAction(name, *it);
+        }
+    }
+}
+
+// Update an item action to the state of its menu item, if it differs.
+void UnityGMenuModelExporter::updateAction(const QByteArray &name, UnityMenuAction &menuAction)
+{
+    UnityPlatformMenuItem *gplatformMenuItem = menuAction.item;
+    if (!gplatformMenuItem) return;
+
+    const bool enabled = UnityPlatformMenuItem::get_enabled(gplatformMenuItem);
+    const bool checked = menuAction.checkable && UnityPlatformMenuItem::get_checked(gplatformMenuItem);
+    if (enabled == menuAction.enabled && checked == menuAction.checked) return;
+
+    GVariant *state = nullptr;
+    if (checked != menuAction.checked) {
+        state = g_variant_new_boolean(checked ? TRUE : FALSE);
+    }
+    menuAction.enabled = enabled;
+    menuAction.checked = checked;
+    setActionState(name, enabled, state);
+}
+
+// Update a radio action to the state of the items of its group, if it differs.
+void UnityGMenuModelExporter::updateRadioAction(const QByteArray &name, UnityMenuAction &menuAction)
+{
+    QByteArray checkedTarget;
+    bool enabled = true;
+    bool first = true;
+    for (auto it = menuAction.targets.constBegin(); it != menuAction.targets.constEnd(); ++it) {
+        UnityPlatformMenuItem *gplatformMenuItem = it.value();
+        if (!gplatformMenuItem) continue;
+
+        if (UnityPlatformMenuItem::get_checked(gplatformMenuItem)) {
+            checkedTarget = it.key();
+        }
+        if (!first && UnityPlatformMenuItem::get_enabled(gplatformMenuItem) != enabled) {
+            // The group can only be exported as a single action while its items agree on being enabled
+            if (menuAction.menu) {
+                Q_EMIT menuAction.menu->structureChanged();
+            }
+            return;
+        }
+        enabled = UnityPlatformMenuItem::get_enabled(gplatformMenuItem);
+        first = false;
+    }
+
+    if (enabled == menuAction.enabled && checkedTarget == menuAction.checkedTarget) return;
+
+    GVariant *state = nullptr;
+    if (checkedTarget != menuAction.checkedTarget) {
+        state = g_variant_new_string(checkedTarget.constData());
+    }
+    menuAction.enabled = enabled;
+    menuAction.checkedTarget = checkedTarget;
+    setActionState(name, enabled, state);
+}
+
+// Apply new enabled and state values to an exported action. Takes the floating state reference, if any.
+void UnityGMenuModelExporter::setActionState(const QByteArray &name, bool enabled, GVariant *state)
+{
+    if (state) {
+        g_variant_ref_sink(state);
+    }
+
+    recordChange(0, name);
+    QByteArray actionName;
+    UnityMenuActionGroup *actionGroup = this->actionGroup(name, &actionName);
+    if (!actionGroup) {
+        if (state) {
+            g_variant_unref(state);
+        }
+        return;
+    }
+    g_object_ref(actionGroup);
+    runInExportContext([actionGroup, actionName, enabled, state]() {
+        unity_menu_action_group_set_enabled(actionGroup, actionName.constData(), enabled);
+        if (state) {
+            unity_menu_action_group_set_state(actionGroup, actionName.constData(), state);
+            g_variant_unref(state);
+        }
+        g_object_unref(actionGroup);
+    });
+}
+
+// Whether the actions of every top level menu of a menubar go in an action group of their own,
+// exported on a path below the one of the menu with the prefix unityN, instead of all of them
+// going in the unity group. Needs a shell which subscribes to the group of a top level menu,
+// announced by the qtunity-actions attribute of its item, when opening it.
+bool UnityGMenuModelExporter::splitActionGroups()
+{
+    static const bool split = [] {
+        const QByteArray splitActions = qgetenv("QTUNITY_MENU_SPLIT_ACTIONS");
+        return !splitActions.isEmpty() && splitActions.at(0) != '0';
+    }();
+    return split;
+}
+
+// Give a top level menu an action group of its own, if it doesn't have one yet.
+// Returns its action prefix.
+QByteArray UnityGMenuModelExporter::addActionGroup(UnityPlatformMenu *gplatformMenu)
+{
+    auto it = m_actionPrefixes.constFind(gplatformMenu);
+    if (it != m_actionPrefixes.constEnd()) return *it;
+
+    const int index = ++m_actionGroupCount;
+    auto splitGroup = new UnitySplitActionGroup;
+    splitGroup->exporter = this;
+    splitGroup->group = unity_menu_action_group_new();
+    splitGroup->prefix = "unity" + QByteArray::number(index);
+    splitGroup->path = m_menuPath.toUtf8() + '/' + QByteArray::number(index);
+    splitGroup->exportId = 0;
+    unity_menu_action_group_set_activate_func(splitGroup->group, activate_split_cb, splitGroup);
+    if (m_modelSignals) {
+        watch_action_signals(G_ACTION_GROUP(splitGroup->group), m_modelSignals);
+    }
+
+    m_actionPrefixes.insert(gplatformMenu, splitGroup->prefix);
+    m_splitActionGroups.insert(splitGroup->prefix, splitGroup);
+
+    // Exported along with the menu, or right away if it is exported already
+    if (m_connection && m_exportedActions != 0) {
+        if (m_threaded) {
+            UnityMenuExportThread::instance()->invokeSync([this]() { exportModelsOnConnection(); });
+        } else {
+            exportModelsOnConnection();
+        }
+    }
+    return splitGroup->prefix;
+}
+
+// Drop the action group of a top level menu which is not part of the menubar any more.
+void UnityGMenuModelExporter::removeActionGroup(UnityPlatformMenu *gplatformMenu)
+{
+    const QByteArray prefix = m_actionPrefixes.take(gplatformMenu);
+    UnitySplitActionGroup *splitGroup = m_splitActionGroups.take(prefix);
+    if (!splitGroup) return;
+
+    GDBusConnection *connection = m_connection;
+    if (connection) {
+        g_object_ref(connection);
+    }
+    runInExportContext([splitGroup, connection]() {
+        if (connection && splitGroup->exportId != 0) {
+            g_dbus_connection_unexport_action_group(connection, splitGroup->exportId);
+        }
+        if (connection) {
+            g_object_unref(connection);
+        }
+        unity_menu_action_group_set_activate_func(splitGroup->group, nullptr, nullptr);
+        g_object_unref(splitGroup->group);
+        delete splitGroup;
+    });
+}
+
+// The prefix of the actions of the items of a platform menu: the one of the
+// group of its top level menu.
+QByteArray UnityGMenuModelExporter::actionPrefix(UnityPlatformMenu *gplatformMenu) const
+{
+    UnityPlatformMenu *topLevelMenu = gplatformMenu;
+    for (; gplatformMenu; gplatformMenu = m_parentMenus.value(gplatformMenu, nullptr)) {
+        topLevelMenu = gplatformMenu;
+    }
+    return m_actionPrefixes.value(topLevelMenu, QByteArrayLiteral("unity"));
+}
+
+// The exported group of a detailed action name, and the name of the action in it.
+UnityMenuActionGroup *UnityGMenuModelExporter::actionGroup(const QByteArray &name, QByteArray *actionName) const
+{
+    const int dot = name.indexOf('.');
+    const QByteArray prefix = name.left(dot);
+    *actionName = name.mid(dot + 1);
+    if (prefix == "unity") return m_gactionGroup;
+
+    UnitySplitActionGroup *splitGroup = m_splitActionGroups.value(prefix, nullptr);
+    return splitGroup ? splitGroup->group : nullptr;
 }
@@ -18,15 +18,127 @@
 #define GMENUMODELEXPORTER_H
 
 #include "gmenumodelplatformmenu.h"
+#include "menuactiongroup.h"
+#include "menusearchindex.h"
 
 #include <gio/gio.h>
 
+#include <QElapsedTimer>
 #include <QTimer>
+#include <QPointer>
 #include <QMap>
+#include <QMutex>
+#include <QQueue>
 #include <QSet>
+#include <QSharedPointer>
 #include <QMetaObject>
 
+#include <functional>
+
 class QtUnityExtraActionHandler;
+class QWindow;
+class UnityGMenuModelExporter;
+
+// Exporter side state of an exported action, also used to tell which state changes
+// need to be forwarded to the action group.
+struct UnityMenuAction
+{
+    // Item actions
+    QPointer<UnityPlatformMenuItem> item;
+    bool checkable = false;
+    bool checked = false;
+
+    // Radio actions of exclusive groups
+    bool radio = false;
+    QPointer<UnityPlatformMenu> menu;
+    QHash<QByteArray, QPointer<UnityPlatformMenuItem>> targets;
+    QByteArray checkedTarget;
+
+    bool enabled = true;
+};
+
+// A page of a paged menu, exported as a continuation submenu which is only
+// filled once the shell is about to show it.
+struct UnityMenuPage
+{
+    UnityPlatformMenu *menu;
+    GMenu *model;
+    // Index of the first item of the page
+    int first;
+    bool revealed;
+};
+
+// A change of the exported menus, kept for getChangesSince: either the items of the submenu
+// of a tag (0 for the whole tree) or the state of an action changed.
+struct UnityMenuChange
+{
+    quint64 revision;
+    quint64 tag;
+    QByteArray action;
+};
+
+// An action group exported on a path of its own, holding the actions of the items of one
+// top level menu, so the shell only subscribes to the actions of the menus it opens.
+struct UnitySplitActionGroup
+{
+    UnityGMenuModelExporter *exporter;
+    UnityMenuActionGroup *group;
+    // The actions of the items are named prefix.action
+    QByteArray prefix;
+    QByteArray path;
+    guint exportId;
+};
+
+struct UnityMenuSnapshot;
+struct UnityModelSignalCounter;
+
+// An item of a UnityMenuSnapshot.
+struct UnityMenuSnapshotItem
+{
+    UnityPlatformMenuItem *item = nullptr;
+    bool separator = false;
+    bool visible = false;
+    QString text;
+    QByteArray accel;
+    // Radio action of the exclusive group of the item, if any
+    QByteArray radioGroup;
+    // Filled in by the build: the detailed action name, or the target in the radio group
+    QByteArray action;
+
+    // Items with a submenu, captured only when it is visible
+    UnityPlatformMenu *submenu = nullptr;
+    bool enabled = false;
+    quint64 tag = 0;
+    QSharedPointer<UnityMenuSnapshot> snapshot;
+};
+
+// A platform menu captured on the gui thread, so its gmenu can be built on another thread,
+// see UnityGMenuModelExporter::buildSubmenusInParallel().
+struct UnityMenuSnapshot
+{
+    UnityPlatformMenu *menu = nullptr;
+    QByteArray key;
+    QByteArray prefix;
+    bool collapsible = false;
+    QVector<UnityMenuSnapshotItem> items;
+
+    // The built gmenu, or an identical one exported already which is linked as it is
+    GMenu *model = nullptr;
+    bool shared = false;
+
+    UnityMenuSnapshot() = default;
+    UnityMenuSnapshot(const UnityMenuSnapshot&) = delete;
+    UnityMenuSnapshot &operator=(const UnityMenuSnapshot&) = delete;
+    ~UnityMenuSnapshot() { if (model) g_object_unref(model); }
+};
+
+// The exporter the export thread posts its calls for the gui thread to, see
+// UnityGMenuModelExporter::runInGuiThread(). Cleared when the exporter goes away.
+struct UnityGuiCallTarget
+{
+    QMutex mutex;
+    UnityGMenuModelExporter *exporter;
+};
 
 // Base class for a gmenumodel exporter
 class UnityGMenuModelExporter : public QObject
@@ -41,31 +153,142 @@ public:
     QString menuPath() const { return m_menuPath;}
 
     void aboutToShow(quint64 tag);
+    void activateAction(const QByteArray &name, GVariant *parameter);
+    void search(const QString &query, uint limit, GDBusMethodInvocation *invocation);
+    void layout(quint64 tag, int depth, GDBusMethodInvocation *invocation);
+    void changesSince(quint64 revision, GDBusMethodInvocation *invocation);
+    void layoutBuffer(quint64 revision, int depth, GDBusMethodInvocation *invocation);
+    void statistics(GDBusMethodInvocation *invocation);
+
+    void watchWindow(QWindow *window);
 
 protected:
     UnityGMenuModelExporter(QObject *parent);
 
-    GMenuItem *createSubmenu(QPlatformMenu* platformMenu, UnityPlatformMenuItem* forItem);
-    GMenuItem *createMenuItem(QPlatformMenuItem* platformMenuItem, GMenu *parentMenu);
-    GMenuItem *createSection(QList<QPlatformMenuItem*>::const_iterator iter, QList<QPlatformMenuItem*>::const_iterator end);
+    GMenuItem *createSubmenu(QPlatformMenu* platformMenu, UnityPlatformMenuItem* forItem, const QByteArray& prefix);
+    GMenuItem *createMenuItem(QPlatformMenuItem* platformMenuItem, GMenu *parentMenu, const QByteArray& prefix);
+    GMenuItem *createSection(QList<QPlatformMenuItem*>::const_iterator iter, QList<QPlatformMenuItem*>::const_iterator end,
+                             GMenu *parentMenu, const QByteArray& prefix);
     void addAction(const QByteArray& name, UnityPlatformMenuItem* gplatformItem, GMenu *parentMenu);
+    void addRadioActions(UnityPlatformMenu* gplatformMenu, GMenu *menu);
+    QHash<UnityPlatformMenuItem*, QByteArray> radioGroups(UnityPlatformMenu* gplatformMenu, const QByteArray& prefix,
+                                                          const QByteArray& path) const;
+    static QByteArray radioGroupPrefix(const QByteArray& prefix, const QByteArray& path);
+    static QByteArray submenuIndexPath(const QByteArray& path, int index);
+    QByteArray menuIndexPath(UnityPlatformMenu* gplatformMenu) const;
+    virtual int topLevelIndex(UnityPlatformMenu* gplatformMenu) const;
+    bool hasMovedRadioGroups(UnityPlatformMenu* gplatformMenu);
+    void insertAction(const QByteArray& name, const GVariantType *parameterType, bool enabled, GVariant *state);
+    void removeAction(const QByteArray& name);
+
+    void scheduleActionUpdate(const QByteArray& name);
+    void flushActionUpdates();
+    void updateAction(const QByteArray& name, UnityMenuAction &menuAction);
+    void updateRadioAction(const QByteArray& name, UnityMenuAction &menuAction);
+    void setActionState(const QByteArray& name, bool enabled, GVariant *state);
+
+    static bool splitActionGroups();
+    QByteArray addActionGroup(UnityPlatformMenu* gplatformMenu);
+    void removeActionGroup(UnityPlatformMenu* gplatformMenu);
+    QByteArray actionPrefix(UnityPlatformMenu* gplatformMenu) const;
+    UnityMenuActionGroup *actionGroup(const QByteArray& name, QByteArray *actionName) const;
 
     void addSubmenuItems(UnityPlatformMenu* gplatformMenu, GMenu* menu);
-    void processItemForGMenu(QPlatformMenuItem* item, GMenu* gmenu);
+    void addMenuPage(UnityPlatformMenu* gplatformMenu, GMenu* menu, int first);
+    QVector<QPair<int, int>> menuSections(UnityPlatformMenu* gplatformMenu, int first, int last);
+    GMenuItem *createContinuation(UnityPlatformMenu* gplatformMenu, int first);
+    void revealMenuPage(quint64 tag);
+    void dropMenuPages(UnityPlatformMenu* gplatformMenu);
+    void processItemForGMenu(QPlatformMenuItem* item, GMenu* gmenu, const QByteArray& prefix);
+
+    static int buildThreads();
+    void buildSubmenusInParallel(const QList<UnityPlatformMenu*> &menus);
+    QSharedPointer<UnityMenuSnapshot> captureSnapshot(UnityPlatformMenu* gplatformMenu, const QByteArray& prefix,
+                                                      const QByteArray& path);
+    void commitSnapshot(UnityMenuSnapshot &snapshot);
+
+    void shareSubmenuModel(UnityPlatformMenu* gplatformMenu, GMenu* menu, const QByteArray& key);
+    void linkSubmenuItems(UnityPlatformMenu* gplatformMenu, GMenu* menu);
+    void addSubmenuActions(UnityPlatformMenu* gplatformMenu, GMenu* menu);
+    void watchSubmenu(UnityPlatformMenu* gplatformMenu);
+    void unwatchSubmenu(UnityPlatformMenu* gplatformMenu);
+    void indexMenuItems(UnityPlatformMenu* gplatformMenu, int first, int last);
+    QStringList submenuPath(UnityPlatformMenu* gplatformMenu) const;
+
+    static bool isSubmenuVisible(UnityPlatformMenu* gplatformMenu, UnityPlatformMenuItem* forItem);
+    void releaseSubtree(UnityPlatformMenu* gplatformMenu);
+    void releaseMenuState(const QList<GMenu*> &menus);
+
+    static int evictAfter();
+    void touchSubmenu(UnityPlatformMenu* gplatformMenu);
+    void evictColdSubmenus(qint64 coldFor, bool keepTopLevel = false);
+    bool evictSubmenu(UnityPlatformMenu* gplatformMenu);
+    void materializeSubmenu(UnityPlatformMenu* gplatformMenu);
+
+    void collectSubmenus(UnityPlatformMenu* gplatformMenu, QVector<QPair<UnityPlatformMenu*, UnityPlatformMenu*>> &submenus);
+    QByteArray subtreeHash(UnityPlatformMenu* gplatformMenu, const QByteArray& prefix, const QByteArray& path);
+    bool isSharedSubtree(UnityPlatformMenu* gplatformMenu) const;
+    void setSubmenuModel(UnityPlatformMenu* gplatformMenu, GMenu* menu);
+    QList<GMenu*> takeSubmenuModels();
+    void releaseSubmenuModels(const QList<GMenu*> &menus);
+
+    void setMenuItems(GMenu *menu, GMenu *content);
+    void insertMenuItem(GMenu *menu, int position, GMenuItem *item);
+    void removeMenuItem(GMenu *menu, int position);
+    void moveMenuItemsState(GMenu *from, GMenu *to);
+
+    void exportModelsOnConnection();
+    void unexportModelsOnConnection();
+    void runInExportContext(const std::function<void()> &call);
+    void runInGuiThread(const std::function<void()> &call, GDBusMethodInvocation *invocation = nullptr);
+
+    virtual GVariant *rootLayout(int depth) = 0;
+    GVariant *menuLayout(UnityPlatformMenu* gplatformMenu, int depth);
+    GVariant *itemLayout(UnityPlatformMenuItem* gplatformMenuItem, const QByteArray& prefix);
+    GVariant *submenuLayout(UnityPlatformMenu* gplatformMenu, UnityPlatformMenuItem* forItem, int depth);
+
+    void recordChange(quint64 tag, const QByteArray& action);
+    bool collectChanges(quint64 revision, QList<quint64> &tags, QList<QByteArray> &actions) const;
+    GVariant *actionStates(const QList<QByteArray> &actions) const;
+
+    virtual QString describeRoot() = 0;
+    QString describeMenu(UnityPlatformMenu* gplatformMenu, int indent, int first = 0);
+    QString describeSubmenu(UnityPlatformMenu* gplatformMenu, UnityPlatformMenuItem* forItem, int indent);
+    void verifyModels();
+    GVariant *liveCounts() const;
 
     void clear();
 
     void timerEvent(QTimerEvent *e) override;
+    void customEvent(QEvent *e) override;
 
 protected:
     GDBusConnection *m_connection;
     GMenu *m_gmainMenu;
-    GSimpleActionGroup *m_gactionGroup;
+    UnityMenuActionGroup *m_gactionGroup;
     guint m_exportedModel;
     guint m_exportedActions;
     QtUnityExtraActionHandler *m_qtunityExtraHandler;
     QTimer m_structureTimer;
+    QTimer m_actionUpdateTimer;
     QString m_menuPath;
+    // Whether the gmenus and actions live on the UnityMenuExportThread
+    const bool m_threaded;
+    QSharedPointer<UnityGuiCallTarget> m_guiCallTarget;
+
+    // Bumped by every change of the exported menus or actions
+    quint64 m_revision;
+    // Changes up to this revision have been dropped from the journal
+    quint64 m_journalStart;
+    QQueue<UnityMenuChange> m_journal;
+
+    // Consistency checks and update statistics, see verifyModels()
+    QTimer m_verifyTimer;
+    QElapsedTimer m_statisticsTimer;
+    int m_mutationCount;
+    // Only with QTUNITY_MENU_VERIFY
+    UnityModelSignalCounter *m_modelSignals;
+    int m_reusedSubmenuCount;
 
     // UnityPlatformMenu::tag -> UnityPlatformMenu
     QMap<quint64, UnityPlatformMenu*> m_submenusWithTag;
@@ -73,9 +296,42 @@ protected:
     // UnityPlatformMenu -> reload TimerId (startTimer)
     QHash<UnityPlatformMenu*, int> m_reloadMenuTimers;
 
+    // Menus connected by watchSubmenu()
+    QSet<UnityPlatformMenu*> m_watchedMenus;
+
+    // Continuation submenu tag -> page of a paged menu
+    QHash<quint64, UnityMenuPage> m_menuPages;
+
+    // Every gmenu in here holds a link in UnitySharedMenuModels
     QHash<UnityPlatformMenu*, GMenu*> m_gmenusForMenus;
+    QHash<UnityPlatformMenu*, UnityPlatformMenu*> m_parentMenus;
+
+    // Idle eviction, with QTUNITY_MENU_EVICT_AFTER: when each submenu was last built or shown,
+    // on m_evictionClock, and the submenus whose gmenu was emptied until they are shown again.
+    QTimer m_evictionTimer;
+    QElapsedTimer m_evictionClock;
+    QHash<UnityPlatformMenu*, qint64> m_lastShown;
+    QSet<UnityPlatformMenu*> m_evictedMenus;
+    QPointer<QWindow> m_window;
+
+    // Content hashes computed during the current (re)build
+    QHash<UnityPlatformMenu*, QByteArray> m_subtreeHashes;
+
+    // Top level menu -> action prefix, and prefix -> action group, with QTUNITY_MENU_SPLIT_ACTIONS.
+    // Kept across rebuilds so the shell keeps its subscriptions.
+    QHash<UnityPlatformMenu*, QByteArray> m_actionPrefixes;
+    QHash<QByteArray, UnitySplitActionGroup*> m_splitActionGroups;
+    int m_actionGroupCount;
 
     QHash<GMenu*, QSet<QByteArray>> m_actions;
+    // detailed action name (prefix.action) -> exporter side state of the action
+    QHash<QByteArray, UnityMenuAction> m_menuActions;
+    // labels of the items of the actions, for the HUD
+    UnityMenuSearchIndex m_searchIndex;
+    // UnityPlatformMenuItem -> radio action of its exclusive group
+    QHash<UnityPlatformMenuItem*, QByteArray> m_radioGroups;
+    // actions to update in the current event loop iteration
+    QSet<QByteArray> m_pendingActionUpdates;
     QHash<GMenu*, QVector<QMetaObject::Connection>> m_propertyConnections;
 
 };
@@ -86,6 +342,23 @@ class UnityMenuBarExporter : public UnityGMenuModelExporter
 public:
     UnityMenuBarExporter(UnityPlatformMenuBar *parent);
     ~UnityMenuBarExporter();
+
+protected:
+    GVariant *rootLayout(int depth) override;
+    QString describeRoot() override;
+    int topLevelIndex(UnityPlatformMenu* gplatformMenu) const override;
+
+    void updateMenuVisibility(UnityPlatformMenu* gplatformMenu);
+
+private:
+    static gboolean prewarm(gpointer user_data);
+    void exportMenuBar();
+
+    UnityPlatformMenuBar *m_bar;
+    // Idle source exporting the menubar before the window is shown
+    guint m_prewarmSource;
+    // The top level menus which have an item in m_gmainMenu, in order
+    QList<UnityPlatformMenu*> m_topLevelMenus;
 };
 
 // Class which exports a qt platform menu.
@@ -95,6 +368,13 @@ class UnityMenuExporter : public UnityGMenuModelExporter
 public:
     UnityMenuExporter(UnityPlatformMenu *parent);
     ~UnityMenuExporter();
+
+protected:
+    GVariant *rootLayout(int depth) override;
+    QString describeRoot() override;
+
+private:
+    UnityPlatformMenu *m_menu;
 };
 
 #endif // GMENUMODELEXPORTER_H
@@ -20,12 +20,17 @@
 #include "registry.h"
 #include "menuregistrar.h"
 #include "logging.h"
+#include "menutrace.h"
 
 // Qt
 #include <QDebug>
+#include <QEvent>
+#include <QMetaMethod>
 #include <QWindow>
 #include <QCoreApplication>
 
+#include <functional>
+
 #define BAR_DEBUG_MSG qCDebug(unityappmenu).nospace() << "UnityPlatformMenuBar[" << (void*)this <<"]::" << __func__
 #define MENU_DEBUG_MSG qCDebug(unityappmenu).nospace() << "UnityPlatformMenu[" << (void*)this <<"]::" << __func__
 #define ITEM_DEBUG_MSG qCDebug(unityappmenu).nospace() << "UnityPlatformMenuItem[" << (void*)this <<"]::" << __func__
@@ -34,6 +39,20 @@ namespace {
 
 int logRecusion = 0;
 
+// Sum of the receivers of every signal of an object, receivers() being protected
+int countConnections(const QMetaObject *metaObject, const std::function<int(const char*)> &receivers)
+{
+    int count = 0;
+    for (int i = 0; i < metaObject->methodCount(); ++i) {
+        const QMetaMethod method = metaObject->method(i);
+        // Cloned signals share the connections of the one with all the arguments
+        if (method.methodType() != QMetaMethod::Signal || (method.attributes() & QMetaMethod::Cloned)) continue;
+
+        count += receivers(QByteArray(QByteArray::number(QSIGNAL_CODE) + method.methodSignature()).constData());
+    }
+    return count;
+}
+
 }
 
 QDebug operator<<(QDebug stream, UnityPlatformMenuBar* bar) {
@@ -55,6 +74,7 @@ UnityPlatformMenuBar::UnityPlatformMenuBar()
     , m_ready(false)
 {
     BAR_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::CreateMenuBar, this);
 
     connect(this, &UnityPlatformMenuBar::menuInserted, this, &UnityPlatformMenuBar::structureChanged);
     connect(this,&UnityPlatformMenuBar::menuRemoved, this, &UnityPlatformMenuBar::structureChanged);
@@ -63,11 +83,18 @@ UnityPlatformMenuBar::UnityPlatformMenuBar()
 UnityPlatformMenuBar::~UnityPlatformMenuBar()
 {
     BAR_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::Destroy, this);
+}
+
+QString UnityPlatformMenuBar::exportedPath() const
+{
+    return m_exporter->menuPath();
 }
 
 void UnityPlatformMenuBar::insertMenu(QPlatformMenu *menu, QPlatformMenu *before)
 {
     BAR_DEBUG_MSG << "(menu=" << menu << ", before=" <<  before << ")";
+    UnityMenuTrace::record(UnityMenuTrace::InsertMenu, this, QVariant(), menu, before);
 
     if (m_menus.contains(menu)) return;
 
@@ -87,6 +114,7 @@ void UnityPlatformMenuBar::insertMenu(QPlatformMenu *menu, QPlatformMenu *before
 void UnityPlatformMenuBar::removeMenu(QPlatformMenu *menu)
 {
     BAR_DEBUG_MSG << "(menu=" << menu << ")";
+    UnityMenuTrace::record(UnityMenuTrace::RemoveMenu, this, QVariant(), menu);
 
     QMutableListIterator<QPlatformMenu*> iterator(m_menus);
     while(iterator.hasNext()) {
@@ -109,8 +137,19 @@ void UnityPlatformMenuBar::handleReparent(QWindow *parentWindow)
 {
     BAR_DEBUG_MSG << "(parentWindow=" << parentWindow << ")";
 
+    QElapsedTimer timer;
+    timer.start();
+
     setReady(true);
     m_registrar->registerMenuForWindow(parentWindow, QDBusObjectPath(m_exporter->menuPath()));
+    m_exporter->watchWindow(parentWindow);
+
+    static bool firstRegistration = true;
+    if (firstRegistration) {
+        firstRegistration = false;
+        qCDebug(unityappmenuTiming, "First menubar registered %lld ms after startup, in %lld ms",
+                unityappmenuStartupTimer().elapsed(), timer.elapsed());
+    }
 }
 
 QPlatformMenu *UnityPlatformMenuBar::menuForTag(quintptr tag) const
@@ -128,6 +167,11 @@ const QList<QPlatformMenu *> UnityPlatformMenuBar::menus() const
     return m_menus;
 }
 
+int UnityPlatformMenuBar::connectionCount() const
+{
+    return countConnections(metaObject(), [this](const char *signal) { return receivers(signal); });
+}
+
 QDebug UnityPlatformMenuBar::operator<<(QDebug stream)
 {
     stream.nospace().noquote() << QString("%1").arg("", logRecusion, QLatin1Char('\t'))
@@ -168,6 +212,7 @@ UnityPlatformMenu::UnityPlatformMenu()
     , m_registrar(nullptr)
 {
     MENU_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::CreateMenu, this);
 
     connect(this, &UnityPlatformMenu::menuItemInserted, this, &UnityPlatformMenu::structureChanged);
     connect(this, &UnityPlatformMenu::menuItemRemoved, this, &UnityPlatformMenu::structureChanged);
@@ -176,11 +221,13 @@ UnityPlatformMenu::UnityPlatformMenu()
 UnityPlatformMenu::~UnityPlatformMenu()
 {
     MENU_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::Destroy, this);
 }
 
 void UnityPlatformMenu::insertMenuItem(QPlatformMenuItem *menuItem, QPlatformMenuItem *before)
 {
     MENU_DEBUG_MSG << "(menuItem=" << menuItem << ", before=" << before << ")";
+    UnityMenuTrace::record(UnityMenuTrace::InsertMenuItem, this, QVariant(), menuItem, before);
 
     if (m_menuItems.contains(menuItem)) return;
 
@@ -201,6 +248,7 @@ void UnityPlatformMenu::insertMenuItem(QPlatformMenuItem *menuItem, QPlatformMen
 void UnityPlatformMenu::removeMenuItem(QPlatformMenuItem *menuItem)
 {
     MENU_DEBUG_MSG << "(menuItem=" << menuItem << ")";
+    UnityMenuTrace::record(UnityMenuTrace::RemoveMenuItem, this, QVariant(), menuItem);
 
     QMutableListIterator<QPlatformMenuItem*> iterator(m_menuItems);
     while(iterator.hasNext()) {
@@ -222,7 +270,22 @@ void UnityPlatformMenu::syncMenuItem(QPlatformMenuItem *menuItem)
 void UnityPlatformMenu::syncSeparatorsCollapsible(bool enable)
 {
     MENU_DEBUG_MSG << "(enable=" << enable << ")";
-    Q_UNUSED(enable)
+    UnityMenuTrace::record(UnityMenuTrace::SetSeparatorsCollapsible, this, enable);
+
+    if (m_separatorsCollapsible != enable) {
+        m_separatorsCollapsible = enable;
+        Q_EMIT structureChanged();
+    }
+}
+
+// Apps opt in to the paged export of a menu with its _unity_menu_page_size property.
+bool UnityPlatformMenu::event(QEvent *e)
+{
+    if (e->type() == QEvent::DynamicPropertyChange &&
+            static_cast<QDynamicPropertyChangeEvent*>(e)->propertyName() == "_unity_menu_page_size") {
+        Q_EMIT structureChanged();
+    }
+    return QPlatformMenu::event(e);
 }
 
 void UnityPlatformMenu::setTag(quintptr tag)
@@ -239,6 +302,7 @@ quintptr UnityPlatformMenu::tag() const
 void UnityPlatformMenu::setText(const QString &text)
 {
     MENU_DEBUG_MSG << "(text=" << text << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetText, this, text);
     if (m_text != text) {
         m_text = text;
     }
@@ -247,6 +311,7 @@ void UnityPlatformMenu::setText(const QString &text)
 void UnityPlatformMenu::setIcon(const QIcon &icon)
 {
     MENU_DEBUG_MSG << "(icon=" << icon.name() << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetIcon, this, icon.name());
 
     if (!icon.isNull() || (!m_icon.isNull() && icon.isNull())) {
         m_icon = icon;
@@ -256,6 +321,7 @@ void UnityPlatformMenu::setIcon(const QIcon &icon)
 void UnityPlatformMenu::setEnabled(bool enabled)
 {
     MENU_DEBUG_MSG << "(enabled=" << enabled << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetEnabled, this, enabled);
 
     if (m_enabled != enabled) {
         m_enabled = enabled;
@@ -266,9 +332,11 @@ void UnityPlatformMenu::setEnabled(bool enabled)
 void UnityPlatformMenu::setVisible(bool isVisible)
 {
     MENU_DEBUG_MSG << "(visible=" << isVisible << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetVisible, this, isVisible);
 
     if (m_visible != isVisible) {
         m_visible = isVisible;
+        Q_EMIT visibleChanged(isVisible);
     }
 }
 
@@ -282,8 +350,7 @@ void UnityPlatformMenu::setMinimumWidth(int width)
 void UnityPlatformMenu::setFont(const QFont &font)
 {
     MENU_DEBUG_MSG << "(font=" << font << ")";
-
-    Q_UNUSED(font)
+    UnityMenuTrace::record(UnityMenuTrace::SetFont, this, font.toString());
 }
 
 void UnityPlatformMenu::showPopup(const QWindow *parentWindow, const QRect &targetRect, const QPlatformMenuItem *item)
@@ -355,6 +422,11 @@ const QList<QPlatformMenuItem *> UnityPlatformMenu::menuItems() const
     return m_menuItems;
 }
 
+int UnityPlatformMenu::connectionCount() const
+{
+    return countConnections(metaObject(), [this](const char *signal) { return receivers(signal); });
+}
+
 QDebug UnityPlatformMenu::operator<<(QDebug stream)
 {
     stream.nospace().noquote() << QString("%1").arg("", logRecusion, QLatin1Char('\t'))
@@ -377,11 +449,13 @@ UnityPlatformMenuItem::UnityPlatformMenuItem()
     , m_tag(reinterpret_cast<quintptr>(this))
 {
     ITEM_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::CreateMenuItem, this);
 }
 
 UnityPlatformMenuItem::~UnityPlatformMenuItem()
 {
     ITEM_DEBUG_MSG << "()";
+    UnityMenuTrace::record(UnityMenuTrace::Destroy, this);
 }
 
 void UnityPlatformMenuItem::setTag(quintptr tag)
@@ -398,6 +472,7 @@ quintptr UnityPlatformMenuItem::tag() const
 void UnityPlatformMenuItem::setText(const QString &text)
 {
     ITEM_DEBUG_MSG << "(text=" << text << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetText, this, text);
     if (m_text != text) {
         m_text = text;
     }
@@ -406,6 +481,7 @@ void UnityPlatformMenuItem::setText(const QString &text)
 void UnityPlatformMenuItem::setIcon(const QIcon &icon)
 {
     ITEM_DEBUG_MSG << "(icon=" << icon.name() << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetIcon, this, icon.name());
 
     if (!icon.isNull() || (!m_icon.isNull() && icon.isNull())) {
         m_icon = icon;
@@ -415,6 +491,7 @@ void UnityPlatformMenuItem::setIcon(const QIcon &icon)
 void UnityPlatformMenuItem::setVisible(bool isVisible)
 {
     ITEM_DEBUG_MSG << "(visible=" << isVisible << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetVisible, this, isVisible);
     if (m_visible != isVisible) {
         m_visible = isVisible;
         Q_EMIT visibleChanged(m_visible);
@@ -424,6 +501,7 @@ void UnityPlatformMenuItem::setVisible(bool isVisible)
 void UnityPlatformMenuItem::setIsSeparator(bool isSeparator)
 {
     ITEM_DEBUG_MSG << "(separator=" << isSeparator << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetSeparator, this, isSeparator);
     if (m_separator != isSeparator) {
         m_separator = isSeparator;
     }
@@ -432,18 +510,19 @@ void UnityPlatformMenuItem::setIsSeparator(bool isSeparator)
 void UnityPlatformMenuItem::setFont(const QFont &font)
 {
     ITEM_DEBUG_MSG << "(font=" << font << ")";
-    Q_UNUSED(font);
+    UnityMenuTrace::record(UnityMenuTrace::SetFont, this, font.toString());
 }
 
 void UnityPlatformMenuItem::setRole(QPlatformMenuItem::MenuRole role)
 {
     ITEM_DEBUG_MSG << "(role=" << role << ")";
-    Q_UNUSED(role);
+    UnityMenuTrace::record(UnityMenuTrace::SetRole, this, static_cast<int>(role));
 }
 
 void UnityPlatformMenuItem::setCheckable(bool checkable)
 {
     ITEM_DEBUG_MSG << "(checkable=" << checkable << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetCheckable, this, checkable);
     if (m_checkable != checkable) {
         m_checkable = checkable;
     }
@@ -452,6 +531,7 @@ void UnityPlatformMenuItem::setCheckable(bool checkable)
 void UnityPlatformMenuItem::setChecked(bool isChecked)
 {
     ITEM_DEBUG_MSG << "(checked=" << isChecked << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetChecked, this, isChecked);
     if (m_checked != isChecked) {
         m_checked = isChecked;
         Q_EMIT checkedChanged(isChecked);
@@ -461,6 +541,7 @@ void UnityPlatformMenuItem::setChecked(bool isChecked)
 void UnityPlatformMenuItem::setShortcut(const QKeySequence &shortcut)
 {
     ITEM_DEBUG_MSG << "(shortcut=" << shortcut << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetShortcut, this, shortcut.toString(QKeySequence::PortableText));
     if (m_shortcut != shortcut) {
         m_shortcut = shortcut;
     }
@@ -469,6 +550,7 @@ void UnityPlatformMenuItem::setShortcut(const QKeySequence &shortcut)
 void UnityPlatformMenuItem::setEnabled(bool enabled)
 {
     ITEM_DEBUG_MSG << "(enabled=" << enabled << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetEnabled, this, enabled);
     if (m_enabled != enabled) {
         m_enabled = enabled;
         Q_EMIT enabledChanged(enabled);
@@ -478,12 +560,25 @@ void UnityPlatformMenuItem::setEnabled(bool enabled)
 void UnityPlatformMenuItem::setIconSize(int size)
 {
     ITEM_DEBUG_MSG << "(size=" << size << ")";
-    Q_UNUSED(size);
+    UnityMenuTrace::record(UnityMenuTrace::SetIconSize, this, size);
 }
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+void UnityPlatformMenuItem::setHasExclusiveGroup(bool hasExclusiveGroup)
+{
+    ITEM_DEBUG_MSG << "(hasExclusiveGroup=" << hasExclusiveGroup << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetExclusiveGroup, this, hasExclusiveGroup);
+    if (m_hasExclusiveGroup != hasExclusiveGroup) {
+        m_hasExclusiveGroup = hasExclusiveGroup;
+        Q_EMIT hasExclusiveGroupChanged(hasExclusiveGroup);
+    }
+}
+#endif
+
 void UnityPlatformMenuItem::setMenu(QPlatformMenu *menu)
 {
     ITEM_DEBUG_MSG << "(menu=" << menu << ")";
+    UnityMenuTrace::record(UnityMenuTrace::SetMenu, this, QVariant(), menu);
     if (m_menu != menu) {
         m_menu = menu;
 
@@ -499,6 +594,11 @@ QPlatformMenu *UnityPlatformMenuItem::menu() const
     return m_menu;
 }
 
+int UnityPlatformMenuItem::connectionCount() const
+{
+    return countConnections(metaObject(), [this](const char *signal) { return receivers(signal); });
+}
+
 QDebug UnityPlatformMenuItem::operator<<(QDebug stream)
 {
     QString properties = "text=\"" + m_text + "\"";
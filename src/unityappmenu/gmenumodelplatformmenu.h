@@ -41,6 +41,9 @@ public:
 
     const QList<QPlatformMenu*> menus() const;
 
+    // Connections to the signals of the menubar, for the exporter statistics
+    int connectionCount() const;
+
     QDebug operator<<(QDebug stream);
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
@@ -105,19 +108,27 @@ public:
 
     const QList<QPlatformMenuItem*> menuItems() const;
 
+    // Connections to the signals of the menu, for the exporter statistics
+    int connectionCount() const;
+
     QDebug operator<<(QDebug stream);
 
+protected:
+    bool event(QEvent *e) override;
+
 Q_SIGNALS:
     void menuItemInserted(QPlatformMenuItem *menuItem);
     void menuItemRemoved(QPlatformMenuItem *menuItem);
     void structureChanged();
     void enabledChanged(bool);
+    void visibleChanged(bool);
 
 private:
     MENU_PROPERTY(UnityPlatformMenu, visible, bool, true)
     MENU_PROPERTY(UnityPlatformMenu, text, QString, QString())
     MENU_PROPERTY(UnityPlatformMenu, enabled, bool, true)
     MENU_PROPERTY(UnityPlatformMenu, icon, QIcon, QIcon())
+    MENU_PROPERTY(UnityPlatformMenu, separatorsCollapsible, bool, true)
 
     quintptr m_tag;
     QList<QPlatformMenuItem*> m_menuItems;
@@ -151,15 +162,22 @@ public:
     virtual void setShortcut(const QKeySequence& shortcut) override;
     virtual void setEnabled(bool enabled) override;
     virtual void setIconSize(int size) override;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+    virtual void setHasExclusiveGroup(bool hasExclusiveGroup) override;
+#endif
 
     QPlatformMenu* menu() const;
 
+    // Connections to the signals of the item, for the exporter statistics
+    int connectionCount() const;
+
     QDebug operator<<(QDebug stream);
 
 Q_SIGNALS:
     void checkedChanged(bool);
     void enabledChanged(bool);
     void visibleChanged(bool);
+    void hasExclusiveGroupChanged(bool);
 
 private:
     MENU_PROPERTY(UnityPlatformMenuItem, separator, bool, false)
@@ -168,6 +186,7 @@ private:
     MENU_PROPERTY(UnityPlatformMenuItem, enabled, bool, true)
     MENU_PROPERTY(UnityPlatformMenuItem, checkable, bool, false)
     MENU_PROPERTY(UnityPlatformMenuItem, checked, bool, false)
+    MENU_PROPERTY(UnityPlatformMenuItem, hasExclusiveGroup, bool, false)
     MENU_PROPERTY(UnityPlatformMenuItem, shortcut, QKeySequence, QKeySequence())
     MENU_PROPERTY(UnityPlatformMenuItem, icon, QIcon, QIcon())
     MENU_PROPERTY(UnityPlatformMenuItem, iconSize, int, 16)
@@ -17,11 +17,17 @@
 #ifndef QUNITYTHEMELOGGING_H
 #define QUNITYTHEMELOGGING_H
 
+#include <QElapsedTimer>
 #include <QLoggingCategory>
 
 #define ASSERT(cond) ((!(cond)) ? qt_assert(#cond,__FILE__,__LINE__) : qt_noop())
 
 Q_DECLARE_LOGGING_CATEGORY(unityappmenu)
 Q_DECLARE_LOGGING_CATEGORY(unityappmenuRegistrar)
+Q_DECLARE_LOGGING_CATEGORY(unityappmenuTiming)
+
+// Started when the platform theme is created, during the QGuiApplication construction.
+// Used to log the time it takes for the first menus to reach the shell.
+const QElapsedTimer &unityappmenuStartupTimer();
 
 #endif  // QUNITYTHEMELOGGING_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mainloopbridge.h"
+#include "logging.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QThread>
+
+void UnityMainLoopBridge::ensure()
+{
+    static bool checked = false;
+    if (checked) return;
+
+    QCoreApplication *app = QCoreApplication::instance();
+    if (!app || QThread::currentThread() != app->thread()) return;
+    checked = true;
+
+    // The glib dispatcher iterates the default context already
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+    if (!dispatcher || dispatcher->inherits("QEventDispatcherGlib")) return;
+
+    GMainContext *context = g_main_context_default();
+    if (!g_main_context_acquire(context)) {
+        qCWarning(unityappmenu, "The default GMainContext is owned by another thread, menu requests may stall");
+        return;
+    }
+    qCDebug(unityappmenu, "Iterating the default GMainContext from the %s event dispatcher",
+            dispatcher->metaObject()->className());
+
+    auto bridge = new UnityMainLoopBridge(context);
+    bridge->setParent(app);
+    // Sources attached from this thread don't wake the context up, check it before sleeping
+    connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, bridge, &UnityMainLoopBridge::watch);
+    bridge->watch();
+}
+
+UnityMainLoopBridge::UnityMainLoopBridge(GMainContext *context)
+    : m_context(context)
+    , m_priority(G_PRIORITY_DEFAULT)
+    , m_dispatching(false)
+{
+    g_main_context_ref(m_context);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &UnityMainLoopBridge::dispatch);
+}
+
+UnityMainLoopBridge::~UnityMainLoopBridge()
+{
+    qDeleteAll(m_readNotifiers);
+    qDeleteAll(m_writeNotifiers);
+    g_main_context_release(m_context);
+    g_main_context_unref(m_context);
+}
+
+// Prepare the context for the next iteration, and watch what it is waiting for.
+void UnityMainLoopBridge::watch()
+{
+    if (m_dispatching) return;
+
+    const bool ready = g_main_context_prepare(m_context, &m_priority);
+
+    gint timeout = -1;
+    int count;
+    while ((count = g_main_context_query(m_context, m_priority, &timeout, m_fds.data(), m_fds.count())) > m_fds.count()) {
+        m_fds.resize(count);
+    }
+    m_fds.resize(count);
+
+    QHash<int, QSocketNotifier*> readNotifiers;
+    QHash<int, QSocketNotifier*> writeNotifiers;
+    auto notifier = [this](QHash<int, QSocketNotifier*> &previous, QHash<int, QSocketNotifier*> &current,
+                           int fd, QSocketNotifier::Type type) {
+        if (current.contains(fd)) return;
+
+        QSocketNotifier *socketNotifier = previous.take(fd);
+        if (!socketNotifier) {
+            socketNotifier = new QSocketNotifier(fd, type);
+            connect(socketNotifier, &QSocketNotifier::activated, this, &UnityMainLoopBridge::dispatch);
+        }
+        current.insert(fd, socketNotifier);
+    };
+    Q_FOREACH(const GPollFD &pollFd, m_fds) {
+        if (pollFd.events & (G_IO_IN | G_IO_PRI | G_IO_HUP | G_IO_ERR)) {
+            notifier(m_readNotifiers, readNotifiers, pollFd.fd, QSocketNotifier::Read);
+        }
+        if (pollFd.events & G_IO_OUT) {
+            notifier(m_writeNotifiers, writeNotifiers, pollFd.fd, QSocketNotifier::Write);
+        }
+    }
+
+    // The descriptors the context doesn't wait for any more, possibly closed already
+    Q_FOREACH(QSocketNotifier *socketNotifier, m_readNotifiers) {
+        socketNotifier->setEnabled(false);
+        socketNotifier->deleteLater();
+    }
+    Q_FOREACH(QSocketNotifier *socketNotifier, m_writeNotifiers) {
+        socketNotifier->setEnabled(false);
+        socketNotifier->deleteLater();
+    }
+    m_readNotifiers.swap(readNotifiers);
+    m_writeNotifiers.swap(writeNotifiers);
+
+    if (ready) {
+        timeout = 0;
+    }
+    if (timeout >= 0) {
+        m_timer.start(timeout);
+    } else {
+        m_timer.stop();
+    }
+}
+
+// Dispatch the sources of the context which are ready, then wait for the next ones.
+void UnityMainLoopBridge::dispatch()
+{
+    if (m_dispatching) return;
+    m_dispatching = true;
+
+    // The notifiers only tell about one descriptor, get the events of all of them
+    if (!m_fds.isEmpty()) {
+        g_poll(m_fds.data(), m_fds.count(), 0);
+    }
+    if (g_main_context_check(m_context, m_priority, m_fds.data(), m_fds.count())) {
+        g_main_context_dispatch(m_context);
+    }
+
+    m_dispatching = false;
+    watch();
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MAINLOOPBRIDGE_H
+#define UNITY_MAINLOOPBRIDGE_H
+
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include <glib.h>
+
+class QSocketNotifier;
+
+// Iterates the default GMainContext from the Qt event loop of the gui thread, for the GDBus
+// exports made there, when Qt doesn't use the glib event dispatcher (QT_NO_GLIB, or a
+// custom dispatcher). The descriptors of the context are watched by socket notifiers and
+// its next timeout by a single shot timer, so it only wakes up when the context has work.
+class UnityMainLoopBridge : public QObject
+{
+    Q_OBJECT
+public:
+    // Installs the bridge, once, if the event dispatcher of the gui thread needs it.
+    // Must be called from the gui thread.
+    static void ensure();
+
+    ~UnityMainLoopBridge();
+
+private:
+    UnityMainLoopBridge(GMainContext *context);
+
+    void watch();
+    void dispatch();
+
+    GMainContext *m_context;
+    gint m_priority;
+    QVector<GPollFD> m_fds;
+    QHash<int, QSocketNotifier*> m_readNotifiers;
+    QHash<int, QSocketNotifier*> m_writeNotifiers;
+    QTimer m_timer;
+    bool m_dispatching;
+};
+
+#endif // UNITY_MAINLOOPBRIDGE_H
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "menuactiongroup.h"
+#include "logging.h"
+
+#include <QByteArray>
+#include <QHash>
+
+namespace {
+
+struct MenuAction
+{
+    bool enabled;
+    // Only set for actions taking a parameter
+    GVariantType *parameterType;
+    // Only set for stateful actions
+    GVariant *state;
+};
+
+void free_menu_action(MenuAction &action)
+{
+    if (action.parameterType) g_variant_type_free(action.parameterType);
+    if (action.state) g_variant_unref(action.state);
+}
+
+}
+
+struct _UnityMenuActionGroup
+{
+    GObject parent_instance;
+
+    QHash<QByteArray, MenuAction> *actions;
+    UnityMenuActionActivateFunc activate;
+    gpointer user_data;
+};
+
+typedef struct
+{
+    GObjectClass parent_class;
+} UnityMenuActionGroupClass;
+
+static void unity_menu_action_group_iface_init(GActionGroupInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(UnityMenuActionGroup, unity_menu_action_group, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_ACTION_GROUP, unity_menu_action_group_iface_init))
+
+static void unity_menu_action_group_finalize(GObject *object)
+{
+    UnityMenuActionGroup *group = UNITY_MENU_ACTION_GROUP(object);
+
+    for (auto it = group->actions->begin(); it != group->actions->end(); ++it) {
+        free_menu_action(it.value());
+    }
+    delete group->actions;
+
+    G_OBJECT_CLASS(unity_menu_action_group_parent_class)->finalize(object);
+}
+
+static void unity_menu_action_group_init(UnityMenuActionGroup *group)
+{
+    group->actions = new QHash<QByteArray, MenuAction>();
+    group->activate = nullptr;
+    group->user_data = nullptr;
+}
+
+static void unity_menu_action_group_class_init(UnityMenuActionGroupClass *klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = unity_menu_action_group_finalize;
+}
+
+static gchar **unity_menu_action_group_list_actions(GActionGroup *action_group)
+{
+    UnityMenuActionGroup *group = UNITY_MENU_ACTION_GROUP(action_group);
+
+    gchar **names = g_new0(gchar*, group->actions->count() + 1);
+    int i = 0;
+    for (auto it = group->actions->constBegin(); it != group->actions->constEnd(); ++it) {
+        names[i++] = g_strdup(it.key().constData());
+    }
+    return names;
+}
+
+static gboolean unity_menu_action_group_query_action(GActionGroup *action_group,
+                                                     const gchar *action_name,
+                                                     gboolean *enabled,
+                                                     const GVariantType **parameter_type,
+                                                     const GVariantType **state_type,
+                                                     GVariant **state_hint,
+                                                     GVariant **state)
+{
+    UnityMenuActionGroup *group = UNITY_MENU_ACTION_GROUP(action_group);
+
+    auto it = group->actions->constFind(QByteArray::fromRawData(action_name, qstrlen(action_name)));
+    if (it == group->actions->constEnd()) return FALSE;
+
+    if (enabled) *enabled = it->enabled;
+    if (parameter_type) *parameter_type = it->parameterType;
+    if (state_type) *state_type = it->state ? g_variant_get_type(it->state) : nullptr;
+    if (state_hint) *state_hint = nullptr;
+    if (state) *state = it->state ? g_variant_ref(it->state) : nullptr;
+    return TRUE;
+}
+
+// Like GSimpleAction, a parameter of another type than the one of the action is rejected,
+// and floating parameters are consumed.
+static void unity_menu_action_group_activate_action(GActionGroup *action_group,
+                                                    const gchar *action_name,
+                                                    GVariant *parameter)
+{
+    UnityMenuActionGroup *group = UNITY_MENU_ACTION_GROUP(action_group);
+
+    if (parameter) g_variant_ref_sink(parameter);
+
+    auto it = group->actions->constFind(QByteArray::fromRawData(action_name, qstrlen(action_name)));
+    if (it == group->actions->constEnd() || !it->enabled) {
+        // Nothing to do
+    } else if (it->parameterType ? !parameter || !g_variant_is_of_type(parameter, it->parameterType) : parameter != nullptr) {
+        gchar *expected = it->parameterType ? g_variant_type_dup_string(it->parameterType) : g_strdup("none");
+        g_warning("Trying to activate action '%s' with a parameter of type '%s' instead of '%s'", action_name,
+                  parameter ? g_variant_get_type_string(parameter) : "none", expected);
+        g_free(expected);
+    } else if (group->activate) {
+        group->activate(action_name, parameter, group->user_data);
+    }
+
+    if (parameter) g_variant_unref(parameter);
+}
+
+// The action states follow the menu items, so requests to change them are handled as activations:
+// a checkable item is only activated when its state differs, a radio group activates the item of
+// the target. Like GSimpleAction, values of another type than the state are rejected.
+static void unity_menu_action_group_change_action_state(GActionGroup *action_group,
+                                                        const gchar *action_name,
+                                                        GVariant *value)
+{
+    UnityMenuActionGroup *group = UNITY_MENU_ACTION_GROUP(action_group);
+
+    g_variant_ref_sink(value);
+
+    auto it = group->actions->constFind(QByteArray::fromRawData(action_name, qstrlen(action_name)));
+    if (it == group->actions->constEnd() || !it->enabled) {
+        // Nothing to do
+    } else if (!it->state) {
+        g_warning("Trying to change the state of action '%s' which is not stateful", action_name);
+    } else if (!g_variant_is_of_type(value, g_variant_get_type(it->state))) {
+        g_warning("Trying to change the state of action '%s' of type '%s' to a value of type '%s'", action_name,
+                  g_variant_get_type_string(it->state), g_variant_get_type_string(value));
+    } else if (group->activate) {
+        group->activate(action_name, value, group->user_data);
+    }
+
+    g_variant_unref(value);
+}
+
+static void unity_menu_action_group_iface_init(GActionGroupInterface *iface)
+{
+    iface->list_actions = unity_menu_action_group_list_actions;
+    iface->query_action = unity_menu_action_group_query_action;
+    iface->activate_action = unity_menu_action_group_activate_action;
+    iface->change_action_state = unity_menu_action_group_change_action_state;
+}
+
+UnityMenuActionGroup *unity_menu_action_group_new()
+{
+    return UNITY_MENU_ACTION_GROUP(g_object_new(UNITY_TYPE_MENU_ACTION_GROUP, nullptr));
+}
+
+void unity_menu_action_group_set_activate_func(UnityMenuActionGroup *group, UnityMenuActionActivateFunc func, gpointer user_data)
+{
+    group->activate = func;
+    group->user_data = user_data;
+}
+
+void unity_menu_action_group_add(UnityMenuActionGroup *group, const gchar *name, const GVariantType *parameterType,
+                                 gboolean enabled, GVariant *state)
+{
+    if (state) g_variant_ref_sink(state);
+
+    unity_menu_action_group_remove(group, name);
+
+    MenuAction action;
+    action.enabled = enabled;
+    action.parameterType = parameterType ? g_variant_type_copy(parameterType) : nullptr;
+    action.state = state;
+    group->actions->insert(QByteArray(name), action);
+
+    g_action_group_action_added(G_ACTION_GROUP(group), name);
+}
+
+void unity_menu_action_group_remove(UnityMenuActionGroup *group, const gchar *name)
+{
+    const QByteArray key(name);
+    if (!group->actions->contains(key)) return;
+
+    // Like GSimpleActionGroup, the action can still be queried by the handlers of action-removed
+    g_action_group_action_removed(G_ACTION_GROUP(group), name);
+
+    // The handlers may have changed the group
+    auto it = group->actions->find(key);
+    if (it == group->actions->end()) return;
+    free_menu_action(it.value());
+    group->actions->erase(it);
+}
+
+void unity_menu_action_group_set_enabled(UnityMenuActionGroup *group, const gchar *name, gboolean enabled)
+{
+    auto it = group->actions->find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it == group->actions->end() || it->enabled == (enabled != FALSE)) return;
+
+    it->enabled = enabled;
+    g_action_group_action_enabled_changed(G_ACTION_GROUP(group), name, enabled);
+}
+
+void unity_menu_action_group_set_state(UnityMenuActionGroup *group, const gchar *name, GVariant *state)
+{
+    g_variant_ref_sink(state);
+
+    auto it = group->actions->find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it == group->actions->end() || !it->state) {
+        qCWarning(unityappmenu, "Trying to set the state of action '%s' which is not stateful", name);
+    } else if (!g_variant_equal(it->state, state)) {
+        g_variant_unref(it->state);
+        it->state = g_variant_ref(state);
+        g_action_group_action_state_changed(G_ACTION_GROUP(group), name, state);
+    }
+
+    g_variant_unref(state);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MENUACTIONGROUP_H
+#define UNITY_MENUACTIONGROUP_H
+
+#include <gio/gio.h>
+
+// GActionGroup exporting the actions of an exporter from a plain table keyed by action
+// name, instead of a GSimpleAction object (and its signal handlers) per menu item.
+// Like the exported gmenus, it must only be used from the context the menus are exported on.
+
+#define UNITY_TYPE_MENU_ACTION_GROUP (unity_menu_action_group_get_type())
+#define UNITY_MENU_ACTION_GROUP(o) (G_TYPE_CHECK_INSTANCE_CAST((o), UNITY_TYPE_MENU_ACTION_GROUP, UnityMenuActionGroup))
+
+typedef struct _UnityMenuActionGroup UnityMenuActionGroup;
+
+// Called for activation and state change requests. parameter is the activation parameter
+// or the requested state, and may be null.
+typedef void (*UnityMenuActionActivateFunc)(const gchar *name, GVariant *parameter, gpointer user_data);
+
+GType unity_menu_action_group_get_type();
+
+UnityMenuActionGroup *unity_menu_action_group_new();
+void unity_menu_action_group_set_activate_func(UnityMenuActionGroup *group, UnityMenuActionActivateFunc func, gpointer user_data);
+
+// Takes the floating reference of state, if any. Replaces an existing action of the same name.
+void unity_menu_action_group_add(UnityMenuActionGroup *group, const gchar *name, const GVariantType *parameterType,
+                                 gboolean enabled, GVariant *state);
+void unity_menu_action_group_remove(UnityMenuActionGroup *group, const gchar *name);
+void unity_menu_action_group_set_enabled(UnityMenuActionGroup *group, const gchar *name, gboolean enabled);
+void unity_menu_action_group_set_state(UnityMenuActionGroup *group, const gchar *name, GVariant *state);
+
+#endif // UNITY_MENUACTIONGROUP_H
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "menulayoutbuffer.h"
+#include "logging.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// glibc only wraps memfd_create since 2.27
+int memfd_new(const char *name)
+{
+    return static_cast<int>(syscall(SYS_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+}
+
+}
+
+int unity_menu_layout_buffer_new(GVariant *payload, guint64 revision, guint64 baseRevision)
+{
+    g_variant_ref_sink(payload);
+
+    UnityMenuLayoutBufferHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "QUML", sizeof(header.magic));
+    header.byteOrder = G_BYTE_ORDER == G_LITTLE_ENDIAN ? 'l' : 'B';
+    header.version = 1;
+    header.revision = revision;
+    header.baseRevision = baseRevision;
+    header.payloadSize = g_variant_get_size(payload);
+    // The payload keeps the 8 bytes alignment GVariant needs to be used in place
+    static_assert(sizeof(UnityMenuLayoutBufferHeader) % 8 == 0, "Misaligned layout buffer payload");
+
+    const size_t size = sizeof(header) + header.payloadSize;
+    const int fd = memfd_new("qtunity-menu-layout");
+    if (fd < 0) {
+        qCWarning(unityappmenu, "Failed to create a layout buffer - %s", strerror(errno));
+        g_variant_unref(payload);
+        return -1;
+    }
+
+    void *data = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+        qCWarning(unityappmenu, "Failed to map a layout buffer of %zu bytes - %s", size, strerror(errno));
+        close(fd);
+        g_variant_unref(payload);
+        return -1;
+    }
+
+    memcpy(data, &header, sizeof(header));
+    g_variant_store(payload, static_cast<char*>(data) + sizeof(header));
+    munmap(data, size);
+    g_variant_unref(payload);
+
+    // The receiver maps it without having to trust us not to change it
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        qCWarning(unityappmenu, "Failed to seal a layout buffer - %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
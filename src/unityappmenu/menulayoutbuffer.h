@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MENULAYOUTBUFFER_H
+#define UNITY_MENULAYOUTBUFFER_H
+
+#include <glib.h>
+
+// Layout buffers are sealed memfds returned by the getLayoutBuffer method of
+// qtunity.actions.extra, which the shell can mmap instead of receiving the layout
+// of big menus in a D-Bus message. A buffer is a header followed by the payload,
+// a serialized GVariant which can be used in place with g_variant_new_from_data().
+struct UnityMenuLayoutBufferHeader
+{
+    char magic[4];          // "QUML"
+    guint8 byteOrder;       // 'l' or 'B', the byte order of the header and the payload
+    guint8 version;         // 1
+    guint16 reserved;
+    // Revision of the exported menus the buffer is up to date with
+    guint64 revision;
+    // 0 if the payload holds the whole tree, otherwise the revision of the previous
+    // generation the payload applies to
+    guint64 baseRevision;
+    guint64 payloadSize;
+};
+
+// The payload, with the layouts of getLayout, is a (a(taa{sv})a(sbav)):
+// - (tag, items) for the tree (tag 0) or for every submenu which changed since the base revision
+// - (action, enabled, state) for every action which changed since the base revision
+#define UNITY_MENU_LAYOUT_BUFFER_TYPE "(a(taa{sv})a(sbav))"
+
+// Write the payload in a new sealed memfd. Takes the floating reference of payload.
+// Returns the file descriptor, or -1 on failure.
+int unity_menu_layout_buffer_new(GVariant *payload, guint64 revision, guint64 baseRevision);
+
+#endif // UNITY_MENULAYOUTBUFFER_H
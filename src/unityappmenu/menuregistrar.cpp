@@ -45,22 +45,11 @@ UnityMenuRegistrar::UnityMenuRegistrar()
     }
     m_service = g_dbus_connection_get_unique_name(m_connection);
     connect(UnityMenuRegistry::instance(), &UnityMenuRegistry::serviceChanged, this, &UnityMenuRegistrar::onRegistrarServiceChanged);
-
-    if (isMirClient()) {
-        auto nativeInterface = qGuiApp->platformNativeInterface();
-        connect(nativeInterface, &QPlatformNativeInterface::windowPropertyChanged, this, [this](QPlatformWindow* window, const QString &property) {
-            if (property != QStringLiteral("persistentSurfaceId")) {
-                return;
-            }
-            if (window->window() == m_window) {
-                registerMenuForWindow(m_window, m_path);
-            }
-        });
-    }
 }
 
 UnityMenuRegistrar::~UnityMenuRegistrar()
 {
+    UnityMenuRegistry::instance()->unwatchSurfaceId(this);
     if (m_connection) {
         g_object_unref(m_connection);
     }
@@ -74,9 +63,18 @@ void UnityMenuRegistrar::registerMenuForWindow(QWindow* window, const QDBusObjec
     m_window = window;
     m_path = path;
 
+    if (isMirClient()) {
+        UnityMenuRegistry::instance()->watchSurfaceId(window, this);
+    }
+
     registerMenu();
 }
 
+void UnityMenuRegistrar::surfaceIdChanged()
+{
+    registerMenuForWindow(m_window, m_path);
+}
+
 void UnityMenuRegistrar::registerMenu()
 {
     if (UnityMenuRegistry::instance()->isConnected() && m_window) {
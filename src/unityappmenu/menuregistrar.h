@@ -34,6 +34,9 @@ public:
     void registerMenuForWindow(QWindow* window, const QDBusObjectPath& path);
     void unregisterMenu();
 
+    // Called by UnityMenuRegistry when the persistentSurfaceId of the window changed
+    void surfaceIdChanged();
+
 private Q_SLOTS:
     void registerSurfaceMenu();
     void onRegistrarServiceChanged();
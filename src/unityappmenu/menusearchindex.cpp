@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "menusearchindex.h"
+
+#include <algorithm>
+
+void UnityMenuSearchIndex::insert(const QObject *menu, const QObject *item, const QByteArray &action,
+                                  const QByteArray &target, const QString &label, const QStringList &path)
+{
+    Entry entry;
+    entry.action = action;
+    entry.target = target;
+    entry.label = label;
+    entry.path = path;
+    entry.text = normalize(label);
+    entry.pathText = normalize(path.join(QLatin1Char(' ')));
+    if (entry.text.isEmpty()) {
+        auto it = m_entries.find(menu);
+        if (it != m_entries.end()) it->remove(item);
+        return;
+    }
+
+    m_entries[menu].insert(item, entry);
+}
+
+void UnityMenuSearchIndex::removeMenu(const QObject *menu)
+{
+    m_entries.remove(menu);
+}
+
+void UnityMenuSearchIndex::moveMenu(const QObject *from, const QObject *to)
+{
+    if (from == to) return;
+
+    const QHash<const QObject*, Entry> entries = m_entries.take(from);
+    if (entries.isEmpty()) return;
+
+    QHash<const QObject*, Entry> &toEntries = m_entries[to];
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        toEntries.insert(it.key(), it.value());
+    }
+}
+
+void UnityMenuSearchIndex::clear()
+{
+    m_entries.clear();
+}
+
+QList<const QObject*> UnityMenuSearchIndex::matchingMenus(const QString &query) const
+{
+    QList<const QObject*> menus;
+    const QString normalizedQuery = normalize(query);
+    if (normalizedQuery.isEmpty()) return menus;
+    const QStringList words = normalizedQuery.split(QLatin1Char(' '));
+
+    for (auto menuIt = m_entries.constBegin(); menuIt != m_entries.constEnd(); ++menuIt) {
+        for (auto it = menuIt->constBegin(); it != menuIt->constEnd(); ++it) {
+            if (score(it.value(), normalizedQuery, words) >= 0) {
+                menus.append(menuIt.key());
+                break;
+            }
+        }
+    }
+    return menus;
+}
+
+QVector<UnityMenuSearchIndex::Result> UnityMenuSearchIndex::search(const QString &query, int limit,
+                                                                   const std::function<bool(const QByteArray&)> &isEnabled) const
+{
+    QVector<Result> results;
+    const QString normalizedQuery = normalize(query);
+    if (normalizedQuery.isEmpty() || limit <= 0) return results;
+    const QStringList words = normalizedQuery.split(QLatin1Char(' '));
+
+    struct Match
+    {
+        int score;
+        const Entry *entry;
+    };
+    QVector<Match> matches;
+    for (auto menuIt = m_entries.constBegin(); menuIt != m_entries.constEnd(); ++menuIt) {
+        for (auto it = menuIt->constBegin(); it != menuIt->constEnd(); ++it) {
+            const Entry &entry = it.value();
+            const int entryScore = score(entry, normalizedQuery, words);
+            if (entryScore >= 0 && isEnabled(entry.action)) {
+                matches.append(Match{entryScore, &entry});
+            }
+        }
+    }
+
+    // Best score first, then shortest label
+    auto lessThan = [](const Match &a, const Match &b) {
+        if (a.score != b.score) return a.score < b.score;
+        return a.entry->text.length() < b.entry->text.length();
+    };
+    const int count = qMin(limit, matches.count());
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end(), lessThan);
+
+    results.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const Entry *entry = matches[i].entry;
+        results.append(Result{entry->action, entry->target, entry->label, entry->path});
+    }
+    return results;
+}
+
+// Lower is better, -1 if the entry doesn't match
+int UnityMenuSearchIndex::score(const Entry &entry, const QString &query, const QStringList &words)
+{
+    if (entry.text == query) return 0;
+    if (entry.text.startsWith(query)) return 1;
+
+    const QStringList labelWords = entry.text.split(QLatin1Char(' '));
+    bool prefixes = true;
+    bool inLabel = true;
+    Q_FOREACH(const QString &word, words) {
+        bool prefix = false;
+        Q_FOREACH(const QString &labelWord, labelWords) {
+            if (labelWord.startsWith(word)) {
+                prefix = true;
+                break;
+            }
+        }
+        prefixes = prefixes && prefix;
+        if (!prefix && !entry.text.contains(word)) {
+            inLabel = false;
+            // Words may also match the submenus, e.g. "format bold"
+            if (!entry.pathText.contains(word)) return -1;
+        }
+    }
+
+    if (prefixes) return 2;
+    if (inLabel) return 3;
+    return 4;
+}
+
+QString UnityMenuSearchIndex::normalize(const QString &text)
+{
+    QString result;
+    result.reserve(text.length());
+
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    for (int i = 0; i < decomposed.length(); ++i) {
+        const QChar c = decomposed.at(i);
+        if (c == QLatin1Char('&')) {
+            // "&&" is a literal ampersand, a single one marks the mnemonic
+            if (i + 1 < decomposed.length() && decomposed.at(i + 1) == QLatin1Char('&')) {
+                result += c;
+                ++i;
+            }
+            continue;
+        }
+        if (c.category() == QChar::Mark_NonSpacing) continue;
+        result += c;
+    }
+
+    return result.toCaseFolded().simplified();
+}
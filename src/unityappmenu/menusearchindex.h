@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MENUSEARCHINDEX_H
+#define UNITY_MENUSEARCHINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+class QObject;
+
+// Index of the labels of the exported menu items, so the HUD can search the commands
+// of an app in one call instead of walking its whole exported menu tree.
+// Entries are keyed by menu item, so items sharing an action name each keep theirs, and are
+// dropped along with the exported content of their platform menu. Evicted menus keep theirs.
+class UnityMenuSearchIndex
+{
+public:
+    struct Result
+    {
+        QByteArray action;
+        // Activation target, only set for the items of radio actions
+        QByteArray target;
+        QString label;
+        QStringList path;
+    };
+
+    // Replaces the entry of the item, if any
+    void insert(const QObject *menu, const QObject *item, const QByteArray &action, const QByteArray &target,
+                const QString &label, const QStringList &path);
+    void removeMenu(const QObject *menu);
+    // Keeps the entries of a menu with those of another, which drops them when it is removed
+    void moveMenu(const QObject *from, const QObject *to);
+    void clear();
+
+    // The menus with entries matching the query, enabled or not
+    QList<const QObject*> matchingMenus(const QString &query) const;
+
+    // Returns the best matches first. Actions for which isEnabled() returns false are skipped.
+    QVector<Result> search(const QString &query, int limit,
+                           const std::function<bool(const QByteArray&)> &isEnabled) const;
+
+    // Lower case text without mnemonics, accents or extra white space.
+    static QString normalize(const QString &text);
+
+private:
+    struct Entry
+    {
+        QByteArray action;
+        QByteArray target;
+        QString label;
+        QStringList path;
+        QString text;
+        QString pathText;
+    };
+
+    static int score(const Entry &entry, const QString &query, const QStringList &words);
+
+    // The entries of the items of every platform menu
+    QHash<const QObject*, QHash<const QObject*, Entry>> m_entries;
+};
+
+#endif // UNITY_MENUSEARCHINDEX_H
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "menutrace.h"
+#include "gmenumodelplatformmenu.h"
+#include "logging.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFont>
+#include <QIcon>
+#include <QKeySequence>
+
+namespace {
+
+static const quint32 s_traceMagic = 0x554d5452; // "UMTR"
+static const quint16 s_traceVersion = 2;
+
+// The type of the value of the events which have one
+bool hasStringValue(quint8 event)
+{
+    return event == UnityMenuTrace::SetText || event == UnityMenuTrace::SetShortcut ||
+           event == UnityMenuTrace::SetIcon || event == UnityMenuTrace::SetFont;
+}
+
+bool hasBoolValue(quint8 event)
+{
+    return event >= UnityMenuTrace::SetEnabled && event <= UnityMenuTrace::SetSeparatorsCollapsible;
+}
+
+bool hasIntValue(quint8 event)
+{
+    return event == UnityMenuTrace::SetRole || event == UnityMenuTrace::SetIconSize;
+}
+
+class TraceWriter
+{
+public:
+    TraceWriter(const QString &path)
+        : m_file(path)
+        , m_nextId(1)
+        , m_pending(0)
+    {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qCWarning(unityappmenu, "Failed to open the menu trace %s", qPrintable(path));
+            return;
+        }
+        m_stream.setDevice(&m_file);
+        m_stream.setVersion(QDataStream::Qt_5_6);
+        m_stream << s_traceMagic << s_traceVersion;
+        m_timer.start();
+    }
+
+    ~TraceWriter()
+    {
+        m_file.flush();
+    }
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    quint32 id(const QObject *object)
+    {
+        if (!object) return 0;
+
+        auto it = m_ids.constFind(object);
+        if (it != m_ids.constEnd()) return *it;
+        m_ids.insert(object, m_nextId);
+        return m_nextId++;
+    }
+
+    void write(quint8 event, const QObject *object, const QVariant &value, const QObject *other, const QObject *before)
+    {
+        m_stream << event << static_cast<quint64>(m_timer.nsecsElapsed() / 1000)
+                 << id(object) << id(other) << id(before);
+        if (hasStringValue(event)) {
+            m_stream << value.toString();
+        } else if (hasBoolValue(event)) {
+            m_stream << value.toBool();
+        } else if (hasIntValue(event)) {
+            m_stream << static_cast<qint32>(value.toInt());
+        }
+
+        // The addresses of destroyed objects get reused
+        if (event == UnityMenuTrace::Destroy) {
+            m_ids.remove(object);
+        }
+
+        // Keep most of the trace when the app crashes
+        if (++m_pending == 256) {
+            m_file.flush();
+            m_pending = 0;
+        }
+    }
+
+private:
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_timer;
+    QHash<const QObject*, quint32> m_ids;
+    quint32 m_nextId;
+    int m_pending;
+};
+
+TraceWriter *traceWriter()
+{
+    static TraceWriter *writer = [] () -> TraceWriter* {
+        const QString path = QString::fromLocal8Bit(qgetenv("QTUNITY_MENU_TRACE"));
+        if (path.isEmpty()) return nullptr;
+        // Destroyed at exit, flushing the trace
+        static TraceWriter traceWriter(path);
+        return traceWriter.isOpen() ? &traceWriter : nullptr;
+    }();
+    return writer;
+}
+
+}
+
+bool UnityMenuTrace::isEnabled()
+{
+    return traceWriter() != nullptr;
+}
+
+void UnityMenuTrace::record(Event event, const QObject *object, const QVariant &value, const QObject *other, const QObject *before)
+{
+    TraceWriter *writer = traceWriter();
+    if (writer) {
+        writer->write(event, object, value, other, before);
+    }
+}
+
+UnityMenuTraceReplay::~UnityMenuTraceReplay()
+{
+    // Menubars go first, they hold on to their menus
+    Q_FOREACH(QObject *object, m_objects) {
+        if (qobject_cast<UnityPlatformMenuBar*>(object)) delete object;
+    }
+    Q_FOREACH(QObject *object, m_objects) {
+        if (!qobject_cast<UnityPlatformMenuBar*>(object)) delete object;
+    }
+}
+
+bool UnityMenuTraceReplay::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(unityappmenu, "Failed to open the menu trace %s", qPrintable(path));
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (magic != s_traceMagic || version != s_traceVersion) {
+        qCWarning(unityappmenu, "%s is not a menu trace", qPrintable(path));
+        return false;
+    }
+
+    m_records.clear();
+    while (!stream.atEnd()) {
+        Record record;
+        stream >> record.event >> record.time >> record.object >> record.other >> record.before;
+        if (hasStringValue(record.event)) {
+            QString value;
+            stream >> value;
+            record.value = value;
+        } else if (hasBoolValue(record.event)) {
+            bool value;
+            stream >> value;
+            record.value = value;
+        } else if (hasIntValue(record.event)) {
+            qint32 value;
+            stream >> value;
+            record.value = value;
+        }
+        // A trace cut short by a crash is still usable up to there
+        if (stream.status() != QDataStream::Ok) break;
+
+        m_records.append(record);
+    }
+    return true;
+}
+
+void UnityMenuTraceReplay::replay(bool realTime)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Q_FOREACH(const Record &record, m_records) {
+        if (realTime) {
+            qint64 remaining;
+            while ((remaining = static_cast<qint64>(record.time / 1000) - timer.elapsed()) > 0) {
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, static_cast<int>(remaining));
+            }
+        }
+
+        apply(record);
+        QCoreApplication::processEvents();
+    }
+}
+
+void UnityMenuTraceReplay::apply(const Record &record)
+{
+    QObject *object = m_objects.value(record.object);
+    auto bar = qobject_cast<UnityPlatformMenuBar*>(object);
+    auto menu = qobject_cast<UnityPlatformMenu*>(object);
+    auto item = qobject_cast<UnityPlatformMenuItem*>(object);
+    auto otherMenu = qobject_cast<UnityPlatformMenu*>(m_objects.value(record.other));
+    auto otherItem = qobject_cast<UnityPlatformMenuItem*>(m_objects.value(record.other));
+
+    switch (record.event) {
+    case UnityMenuTrace::CreateMenuBar:
+        m_objects.insert(record.object, new UnityPlatformMenuBar());
+        break;
+    case UnityMenuTrace::CreateMenu:
+        m_objects.insert(record.object, new UnityPlatformMenu());
+        break;
+    case UnityMenuTrace::CreateMenuItem:
+        m_objects.insert(record.object, new UnityPlatformMenuItem());
+        break;
+    case UnityMenuTrace::Destroy:
+        delete m_objects.take(record.object);
+        break;
+    case UnityMenuTrace::InsertMenu:
+        if (bar && otherMenu) bar->insertMenu(otherMenu, qobject_cast<UnityPlatformMenu*>(m_objects.value(record.before)));
+        break;
+    case UnityMenuTrace::RemoveMenu:
+        if (bar && otherMenu) bar->removeMenu(otherMenu);
+        break;
+    case UnityMenuTrace::InsertMenuItem:
+        if (menu && otherItem) menu->insertMenuItem(otherItem, qobject_cast<UnityPlatformMenuItem*>(m_objects.value(record.before)));
+        break;
+    case UnityMenuTrace::RemoveMenuItem:
+        if (menu && otherItem) menu->removeMenuItem(otherItem);
+        break;
+    case UnityMenuTrace::SetMenu:
+        if (item) item->setMenu(otherMenu);
+        break;
+    case UnityMenuTrace::SetText:
+        if (menu) menu->setText(record.value.toString());
+        if (item) item->setText(record.value.toString());
+        break;
+    case UnityMenuTrace::SetShortcut:
+        if (item) item->setShortcut(QKeySequence::fromString(record.value.toString(), QKeySequence::PortableText));
+        break;
+    case UnityMenuTrace::SetEnabled:
+        if (menu) menu->setEnabled(record.value.toBool());
+        if (item) item->setEnabled(record.value.toBool());
+        break;
+    case UnityMenuTrace::SetVisible:
+        if (menu) menu->setVisible(record.value.toBool());
+        if (item) item->setVisible(record.value.toBool());
+        break;
+    case UnityMenuTrace::SetSeparator:
+        if (item) item->setIsSeparator(record.value.toBool());
+        break;
+    case UnityMenuTrace::SetCheckable:
+        if (item) item->setCheckable(record.value.toBool());
+        break;
+    case UnityMenuTrace::SetChecked:
+        if (item) item->setChecked(record.value.toBool());
+        break;
+    case UnityMenuTrace::SetExclusiveGroup:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+        if (item) item->setHasExclusiveGroup(record.value.toBool());
+#endif
+        break;
+    case UnityMenuTrace::SetSeparatorsCollapsible:
+        if (menu) menu->syncSeparatorsCollapsible(record.value.toBool());
+        break;
+    case UnityMenuTrace::AboutToShow:
+        if (menu) Q_EMIT menu->aboutToShow();
+        break;
+    case UnityMenuTrace::Activate:
+        if (item) Q_EMIT item->activated();
+        break;
+    case UnityMenuTrace::SetIcon: {
+        const QIcon icon = record.value.toString().isEmpty() ? QIcon() : QIcon::fromTheme(record.value.toString());
+        if (menu) menu->setIcon(icon);
+        if (item) item->setIcon(icon);
+        break;
+    }
+    case UnityMenuTrace::SetFont: {
+        QFont font;
+        font.fromString(record.value.toString());
+        if (menu) menu->setFont(font);
+        if (item) item->setFont(font);
+        break;
+    }
+    case UnityMenuTrace::SetRole:
+        if (item) item->setRole(static_cast<QPlatformMenuItem::MenuRole>(record.value.toInt()));
+        break;
+    case UnityMenuTrace::SetIconSize:
+        if (item) item->setIconSize(record.value.toInt());
+        break;
+    default:
+        qCWarning(unityappmenu, "Unknown menu trace event %d", record.event);
+        break;
+    }
+}
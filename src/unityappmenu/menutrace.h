@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MENUTRACE_H
+#define UNITY_MENUTRACE_H
+
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+class QObject;
+
+// Recording of the calls made on the platform menus, to replay the menus of real apps
+// through the exporter when profiling it.
+//
+// Enabled by setting QTUNITY_MENU_TRACE to the path of the trace file. The trace is a
+// QDataStream of records: event, time in microseconds since the recording started,
+// ids of the objects involved, and the value set if any. Objects get small ids in
+// creation order.
+class UnityMenuTrace
+{
+public:
+    enum Event : quint8 {
+        CreateMenuBar = 1,
+        CreateMenu,
+        CreateMenuItem,
+        Destroy,
+        InsertMenu,         // object: menubar, other: menu, before: menu
+        RemoveMenu,         // object: menubar, other: menu
+        InsertMenuItem,     // object: menu, other: item, before: item
+        RemoveMenuItem,     // object: menu, other: item
+        SetMenu,            // object: item, other: menu
+        SetText,            // value: string
+        SetShortcut,        // value: portable text of the key sequence
+        SetEnabled,         // value: bool
+        SetVisible,
+        SetSeparator,
+        SetCheckable,
+        SetChecked,
+        SetExclusiveGroup,
+        SetSeparatorsCollapsible,
+        AboutToShow,        // object: menu
+        Activate,           // object: item
+        SetIcon,            // value: theme name of the icon, the pixmaps aren't recorded
+        SetFont,            // value: QFont::toString()
+        SetRole,            // value: int
+        SetIconSize
+    };
+
+    static bool isEnabled();
+    static void record(Event event, const QObject *object, const QVariant &value = QVariant(),
+                       const QObject *other = nullptr, const QObject *before = nullptr);
+};
+
+// Replays a trace recorded by UnityMenuTrace on new platform menus, without a window
+// or a shell, so the exporter goes through the same updates as in the recorded app. See unity-menu-replay.
+class UnityMenuTraceReplay
+{
+public:
+    ~UnityMenuTraceReplay();
+
+    bool load(const QString &path);
+    int count() const { return m_records.count(); }
+
+    // Replays the whole trace, processing the events of the exporters after every record.
+    // With realTime, waits for the recorded time of each record, otherwise goes as fast as possible.
+    void replay(bool realTime);
+
+private:
+    struct Record
+    {
+        quint8 event;
+        quint64 time;
+        quint32 object;
+        quint32 other;
+        quint32 before;
+        QVariant value;
+    };
+
+    void apply(const Record &record);
+
+    QVector<Record> m_records;
+    QHash<quint32, QObject*> m_objects;
+};
+
+#endif // UNITY_MENUTRACE_H
@@ -25,6 +25,32 @@ static const gchar introspection_xml[] =
   "    <method name='aboutToShow'>"
   "      <arg type='t' name='tag' direction='in'/>"
   "    </method>"
+  "    <method name='search'>"
+  "      <arg type='s' name='query' direction='in'/>"
+  "      <arg type='u' name='limit' direction='in'/>"
+  "      <arg type='a(savsas)' name='results' direction='out'/>"
+  "    </method>"
+  "    <method name='getLayout'>"
+  "      <arg type='t' name='tag' direction='in'/>"
+  "      <arg type='i' name='depth' direction='in'/>"
+  "      <arg type='aa{sv}' name='items' direction='out'/>"
+  "    </method>"
+  "    <method name='getChangesSince'>"
+  "      <arg type='t' name='revision' direction='in'/>"
+  "      <arg type='t' name='current' direction='out'/>"
+  "      <arg type='b' name='resync' direction='out'/>"
+  "      <arg type='at' name='submenus' direction='out'/>"
+  "      <arg type='a(sbav)' name='actions' direction='out'/>"
+  "    </method>"
+  "    <method name='getLayoutBuffer'>"
+  "      <arg type='t' name='revision' direction='in'/>"
+  "      <arg type='i' name='depth' direction='in'/>"
+  "      <arg type='h' name='buffer' direction='out'/>"
+  "      <arg type='t' name='current' direction='out'/>"
+  "    </method>"
+  "    <method name='getStatistics'>"
+  "      <arg type='a{sv}' name='counts' direction='out'/>"
+  "    </method>"
   "  </interface>"
   "</node>";
 
@@ -49,6 +75,69 @@ static void handle_method_call (GDBusConnection       *,
         }
 
         g_dbus_method_invocation_return_value (invocation, NULL);
+    } else if (g_strcmp0 (method_name, "search") == 0) {
+        if (g_variant_check_format_string(parameters, "(&su)", false)) {
+            auto obj = static_cast<UnityGMenuModelExporter*>(user_data);
+            const gchar *query;
+            guint32 limit;
+
+            g_variant_get (parameters, "(&su)", &query, &limit);
+            // replies once the index has been searched on the gui thread
+            obj->search(QString::fromUtf8(query), limit, invocation);
+        } else {
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR,
+                                                  G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Invalid arguments");
+        }
+    } else if (g_strcmp0 (method_name, "getLayout") == 0) {
+        if (g_variant_check_format_string(parameters, "(ti)", false)) {
+            auto obj = static_cast<UnityGMenuModelExporter*>(user_data);
+            guint64 tag;
+            gint32 depth;
+
+            g_variant_get (parameters, "(ti)", &tag, &depth);
+            // replies once the layout has been built on the gui thread
+            obj->layout(tag, depth, invocation);
+        } else {
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR,
+                                                  G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Invalid arguments");
+        }
+    } else if (g_strcmp0 (method_name, "getChangesSince") == 0) {
+        if (g_variant_check_format_string(parameters, "(t)", false)) {
+            auto obj = static_cast<UnityGMenuModelExporter*>(user_data);
+            guint64 revision;
+
+            g_variant_get (parameters, "(t)", &revision);
+            // replies once the journal has been read on the gui thread
+            obj->changesSince(revision, invocation);
+        } else {
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR,
+                                                  G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Invalid arguments");
+        }
+    } else if (g_strcmp0 (method_name, "getLayoutBuffer") == 0) {
+        if (g_variant_check_format_string(parameters, "(ti)", false)) {
+            auto obj = static_cast<UnityGMenuModelExporter*>(user_data);
+            guint64 revision;
+            gint32 depth;
+
+            g_variant_get (parameters, "(ti)", &revision, &depth);
+            // replies once the buffer has been written on the gui thread
+            obj->layoutBuffer(revision, depth, invocation);
+        } else {
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR,
+                                                  G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Invalid arguments");
+        }
+    } else if (g_strcmp0 (method_name, "getStatistics") == 0) {
+        auto obj = static_cast<UnityGMenuModelExporter*>(user_data);
+        // replies once the counts have been read on the gui thread
+        obj->statistics(invocation);
     } else {
         g_dbus_method_invocation_return_error(invocation,
                                               G_DBUS_ERROR,
@@ -16,16 +16,60 @@
 
 #include "registry.h"
 #include "logging.h"
+#include "menuregistrar.h"
 #include "menuregistrar_interface.h"
 
+#include <QDBusError>
+#include <QDBusMetaType>
 #include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
 #include <QDBusServiceWatcher>
+#include <QGuiApplication>
+#include <QWindow>
+#include <qpa/qplatformnativeinterface.h>
+#include <qpa/qplatformwindow.h>
 
 Q_LOGGING_CATEGORY(unityappmenuRegistrar, "unityappmenu.registrar", QtWarningMsg)
 
 #define REGISTRAR_SERVICE "io.unity8.MenuRegistrar"
 #define REGISTRY_OBJECT_PATH "/io/unity8/MenuRegistrar"
 
+QDBusArgument &operator<<(QDBusArgument &argument, const UnityMenuRegistration &registration)
+{
+    argument.beginStructure();
+    argument << registration.add << registration.surfaceId << registration.pid
+             << registration.menuObjectPath << registration.menuObjectPath << registration.service;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, UnityMenuRegistration &registration)
+{
+    QDBusObjectPath actionObjectPath;
+    argument.beginStructure();
+    argument >> registration.add >> registration.surfaceId >> registration.pid
+             >> registration.menuObjectPath >> actionObjectPath >> registration.service;
+    argument.endStructure();
+    return argument;
+}
+
+namespace {
+
+bool sameMenu(const UnityMenuRegistration &a, const UnityMenuRegistration &b)
+{
+    return a.surfaceId == b.surfaceId && a.pid == b.pid && a.menuObjectPath == b.menuObjectPath;
+}
+
+bool containsMenu(const QList<UnityMenuRegistration> &registrations, const UnityMenuRegistration &registration)
+{
+    Q_FOREACH(const UnityMenuRegistration &other, registrations) {
+        if (sameMenu(other, registration)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
 UnityMenuRegistry *UnityMenuRegistry::instance()
 {
     static UnityMenuRegistry* registry(new UnityMenuRegistry());
@@ -37,8 +81,19 @@ UnityMenuRegistry::UnityMenuRegistry(QObject* parent)
     , m_serviceWatcher(new QDBusServiceWatcher(REGISTRAR_SERVICE, QDBusConnection::sessionBus(), QDBusServiceWatcher::WatchForOwnerChange, this))
     , m_interface(new IoUnity8MenuRegistrarInterface(REGISTRAR_SERVICE, REGISTRY_OBJECT_PATH, QDBusConnection::sessionBus(), this))
     , m_connected(m_interface->isValid())
+    , m_batchSupport(BatchUnknown)
+    , m_probingBatchSupport(false)
+    , m_registrarGeneration(0)
+    , m_watchingWindowProperties(false)
 {
+    qDBusRegisterMetaType<UnityMenuRegistration>();
+    qDBusRegisterMetaType<QList<UnityMenuRegistration>>();
+
     connect(m_serviceWatcher.data(), &QDBusServiceWatcher::serviceOwnerChanged, this, &UnityMenuRegistry::serviceOwnerChanged);
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, &QTimer::timeout, this, &UnityMenuRegistry::flushRegistrations);
 }
 
 UnityMenuRegistry::~UnityMenuRegistry()
@@ -52,7 +107,7 @@ void UnityMenuRegistry::registerApplicationMenu(pid_t pid, QDBusObjectPath menuO
             qPrintable(menuObjectPath.path()),
             qPrintable(service));
 
-    m_interface->RegisterAppMenu(pid, menuObjectPath, menuObjectPath, service);
+    queueRegistration(UnityMenuRegistration{true, QString(), static_cast<uint>(pid), menuObjectPath, service});
 }
 
 void UnityMenuRegistry::unregisterApplicationMenu(pid_t pid, QDBusObjectPath menuObjectPath)
@@ -61,7 +116,7 @@ void UnityMenuRegistry::unregisterApplicationMenu(pid_t pid, QDBusObjectPath men
             pid,
             qPrintable(menuObjectPath.path()));
 
-    m_interface->UnregisterAppMenu(pid, menuObjectPath);
+    queueRegistration(UnityMenuRegistration{false, QString(), static_cast<uint>(pid), menuObjectPath, QString()});
 }
 
 void UnityMenuRegistry::registerSurfaceMenu(const QString &surfaceId, QDBusObjectPath menuObjectPath, const QString &service)
@@ -71,7 +126,7 @@ void UnityMenuRegistry::registerSurfaceMenu(const QString &surfaceId, QDBusObjec
             qPrintable(menuObjectPath.path()),
             qPrintable(service));
 
-    m_interface->RegisterSurfaceMenu(surfaceId, menuObjectPath, menuObjectPath, service);
+    queueRegistration(UnityMenuRegistration{true, surfaceId, 0, menuObjectPath, service});
 }
 
 void UnityMenuRegistry::unregisterSurfaceMenu(const QString &surfaceId, QDBusObjectPath menuObjectPath)
@@ -80,9 +135,167 @@ void UnityMenuRegistry::unregisterSurfaceMenu(const QString &surfaceId, QDBusObj
             qPrintable(surfaceId),
             qPrintable(menuObjectPath.path()));
 
-    m_interface->UnregisterSurfaceMenu(surfaceId, menuObjectPath);
+    queueRegistration(UnityMenuRegistration{false, surfaceId, 0, menuObjectPath, QString()});
 }
 
+void UnityMenuRegistry::queueRegistration(const UnityMenuRegistration &registration)
+{
+    if (!registration.add) {
+        // A registration which wasn't sent yet doesn't need to be undone
+        for (int i = m_pendingRegistrations.count() - 1; i >= 0; --i) {
+            const UnityMenuRegistration &pending = m_pendingRegistrations.at(i);
+            if (sameMenu(pending, registration)) {
+                if (pending.add) {
+                    m_pendingRegistrations.removeAt(i);
+                    return;
+                }
+                break;
+            }
+        }
+
+        // Nothing to keep the order with. Menus going away at exit would never get unregistered
+        // if we waited for the event loop, or for the reply to the batch being probed.
+        if (m_pendingRegistrations.isEmpty() || m_probingBatchSupport) {
+            if (m_probingBatchSupport) {
+                m_unregisteredWhileProbing.append(registration);
+            }
+            sendRegistration(registration);
+            return;
+        }
+    }
+
+    m_pendingRegistrations.append(registration);
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+// Send the (un)registrations queued during the last event loop iteration. Registrars
+// without ApplyMenuRegistrations get them one by one, as the first batch tells.
+void UnityMenuRegistry::flushRegistrations()
+{
+    // Keep the order until we know how to send them
+    if (m_probingBatchSupport || m_pendingRegistrations.isEmpty()) return;
+
+    QList<UnityMenuRegistration> registrations;
+    registrations.swap(m_pendingRegistrations);
+
+    if (registrations.count() == 1 || m_batchSupport == BatchUnsupported) {
+        Q_FOREACH(const UnityMenuRegistration &registration, registrations) {
+            sendRegistration(registration);
+        }
+        return;
+    }
+
+    qCDebug(unityappmenuRegistrar, "UnityMenuRegistry::flushRegistrations(count=%d)", registrations.count());
+
+    QDBusPendingCall call = m_interface->ApplyMenuRegistrations(registrations);
+    if (m_batchSupport == BatchUnknown) {
+        m_probingBatchSupport = true;
+        const quint32 generation = m_registrarGeneration;
+        auto watcher = new QDBusPendingCallWatcher(call, this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                [this, registrations, generation](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+            // The menus are registered again with the new owner, see serviceOwnerChanged()
+            if (generation != m_registrarGeneration) return;
+            m_probingBatchSupport = false;
+
+            if (watcher->isError()) {
+                const QDBusError error = watcher->error();
+                if (error.type() == QDBusError::UnknownMethod) {
+                    qCDebug(unityappmenuRegistrar, "Registrar doesn't support batches - %s", qPrintable(error.message()));
+                    m_batchSupport = BatchUnsupported;
+                } else {
+                    // The next batch probes again
+                    qCWarning(unityappmenuRegistrar, "Failed to apply menu registrations - %s", qPrintable(error.message()));
+                }
+                Q_FOREACH(const UnityMenuRegistration &registration, registrations) {
+                    // Don't register again the menus unregistered since
+                    if (!registration.add || !containsMenu(m_unregisteredWhileProbing, registration)) {
+                        sendRegistration(registration);
+                    }
+                }
+            } else {
+                m_batchSupport = BatchSupported;
+            }
+            m_unregisteredWhileProbing.clear();
+            flushRegistrations();
+        });
+    }
+}
+
+void UnityMenuRegistry::sendRegistration(const UnityMenuRegistration &registration)
+{
+    if (registration.surfaceId.isEmpty()) {
+        if (registration.add) {
+            m_interface->RegisterAppMenu(registration.pid, registration.menuObjectPath, registration.menuObjectPath,
+                                         registration.service);
+        } else {
+            m_interface->UnregisterAppMenu(registration.pid, registration.menuObjectPath);
+        }
+    } else {
+        if (registration.add) {
+            m_interface->RegisterSurfaceMenu(registration.surfaceId, registration.menuObjectPath, registration.menuObjectPath,
+                                             registration.service);
+        } else {
+            m_interface->UnregisterSurfaceMenu(registration.surfaceId, registration.menuObjectPath);
+        }
+    }
+}
+
+
+void UnityMenuRegistry::watchSurfaceId(QWindow *window, UnityMenuRegistrar *registrar)
+{
+    unwatchSurfaceId(registrar);
+    if (!window) return;
+
+    if (!m_watchingWindowProperties) {
+        m_watchingWindowProperties = true;
+        connect(qGuiApp->platformNativeInterface(), &QPlatformNativeInterface::windowPropertyChanged,
+                this, &UnityMenuRegistry::windowPropertyChanged);
+    }
+    if (!m_surfaceIdWatchers.contains(window)) {
+        // A window created later at the same address mustn't get the registrars of this one
+        connect(window, &QObject::destroyed, this, &UnityMenuRegistry::watchedWindowDestroyed);
+    }
+    m_surfaceIdWatchers.insert(window, registrar);
+    m_watchedWindows.insert(registrar, window);
+}
+
+void UnityMenuRegistry::unwatchSurfaceId(UnityMenuRegistrar *registrar)
+{
+    QWindow *window = m_watchedWindows.take(registrar);
+    if (!window) return;
+
+    m_surfaceIdWatchers.remove(window, registrar);
+    if (!m_surfaceIdWatchers.contains(window)) {
+        disconnect(window, &QObject::destroyed, this, &UnityMenuRegistry::watchedWindowDestroyed);
+    }
+}
+
+void UnityMenuRegistry::watchedWindowDestroyed(QObject *object)
+{
+    // Only used as a key, the window is gone
+    QWindow *window = static_cast<QWindow*>(object);
+    Q_FOREACH(UnityMenuRegistrar *registrar, m_surfaceIdWatchers.values(window)) {
+        m_watchedWindows.remove(registrar);
+    }
+    m_surfaceIdWatchers.remove(window);
+}
+
+void UnityMenuRegistry::windowPropertyChanged(QPlatformWindow *window, const QString &property)
+{
+    if (property != QStringLiteral("persistentSurfaceId")) {
+        return;
+    }
+
+    // The registrars update their watch while handling the change
+    const QList<UnityMenuRegistrar*> registrars = m_surfaceIdWatchers.values(window->window());
+    Q_FOREACH(UnityMenuRegistrar *registrar, registrars) {
+        registrar->surfaceIdChanged();
+    }
+}
 
 void UnityMenuRegistry::serviceOwnerChanged(const QString &serviceName, const QString& oldOwner, const QString &newOwner)
 {
@@ -92,6 +305,14 @@ void UnityMenuRegistry::serviceOwnerChanged(const QString &serviceName, const QS
 
     if (oldOwner != newOwner) {
         m_connected = !newOwner.isEmpty();
+        // The new registrar may be a different implementation, and knows nothing of the
+        // registrations made with the previous one. The registrars register again.
+        m_batchSupport = BatchUnknown;
+        m_probingBatchSupport = false;
+        m_registrarGeneration++;
+        m_pendingRegistrations.clear();
+        m_unregisteredWhileProbing.clear();
+        m_flushTimer.stop();
         Q_EMIT serviceChanged();
     }
 }
@@ -17,12 +17,36 @@
 #ifndef UNITY_MENU_REGISTRY_H
 #define UNITY_MENU_REGISTRY_H
 
+#include <QDBusArgument>
+#include <QDBusObjectPath>
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
 #include <QObject>
 #include <QScopedPointer>
+#include <QTimer>
 
 class IoUnity8MenuRegistrarInterface;
-class QDBusObjectPath;
 class QDBusServiceWatcher;
+class QPlatformWindow;
+class QWindow;
+class UnityMenuRegistrar;
+
+// One (un)registration of a batch sent to ApplyMenuRegistrations(a(bsuoos)), an optional
+// extension of io.unity8.MenuRegistrar taking (register, surface, pid, menuObjectPath,
+// actionObjectPath, service) tuples. Surface menus have a surface id, application menus a pid.
+struct UnityMenuRegistration
+{
+    bool add;
+    QString surfaceId;
+    uint pid;
+    QDBusObjectPath menuObjectPath;
+    QString service;
+};
+Q_DECLARE_METATYPE(UnityMenuRegistration)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const UnityMenuRegistration &registration);
+const QDBusArgument &operator>>(const QDBusArgument &argument, UnityMenuRegistration &registration);
 
 class UnityMenuRegistry : public QObject
 {
@@ -41,16 +65,49 @@ public:
 
     bool isConnected() const { return m_connected; }
 
+    // Route the persistentSurfaceId changes of a window to the registrar of its menu.
+    // One connection for the whole process instead of one per registrar.
+    void watchSurfaceId(QWindow *window, UnityMenuRegistrar *registrar);
+    void unwatchSurfaceId(UnityMenuRegistrar *registrar);
+
 Q_SIGNALS:
     void serviceChanged();
 
 private Q_SLOTS:
     void serviceOwnerChanged(const QString &serviceName, const QString& oldOwner, const QString &newOwner);
+    void windowPropertyChanged(QPlatformWindow *window, const QString &property);
+    void watchedWindowDestroyed(QObject *object);
 
 private:
+    enum BatchSupport {
+        BatchUnknown,
+        BatchSupported,
+        BatchUnsupported
+    };
+
+    void queueRegistration(const UnityMenuRegistration &registration);
+    void flushRegistrations();
+    void sendRegistration(const UnityMenuRegistration &registration);
+
     QScopedPointer<QDBusServiceWatcher> m_serviceWatcher;
     QScopedPointer<IoUnity8MenuRegistrarInterface> m_interface;
     bool m_connected;
+
+    // (Un)registrations are sent in one batch per event loop iteration
+    QList<UnityMenuRegistration> m_pendingRegistrations;
+    QTimer m_flushTimer;
+    BatchSupport m_batchSupport;
+    // Whether the first batch sent to the registrar awaits its reply
+    bool m_probingBatchSupport;
+    // Unregistrations sent while the first batch awaits its reply, which don't wait for it
+    QList<UnityMenuRegistration> m_unregisteredWhileProbing;
+    // Bumped when the registrar changes owner, the replies of the previous owner are dropped
+    quint32 m_registrarGeneration;
+
+    QMultiHash<QWindow*, UnityMenuRegistrar*> m_surfaceIdWatchers;
+    // The window each registrar watches, to unwatch without walking all the windows
+    QHash<UnityMenuRegistrar*, QWindow*> m_watchedWindows;
+    bool m_watchingWindowProperties;
 };
 
 #endif // UNITY_MENU_REGISTRY_H
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sharedmenumodels.h"
+#include "logging.h"
+
+UnitySharedMenuModels *UnitySharedMenuModels::instance()
+{
+    static UnitySharedMenuModels* models(new UnitySharedMenuModels());
+    return models;
+}
+
+GMenu *UnitySharedMenuModels::lookup(const QByteArray &key) const
+{
+    return m_menusForKeys.value(key, nullptr);
+}
+
+void UnitySharedMenuModels::insert(const QByteArray &key, GMenu *menu, const QVector<QPair<GMenu*, quint64>> &submenus)
+{
+    auto it = m_entries.find(menu);
+    if (it == m_entries.end()) {
+        qCWarning(unityappmenu, "Trying to share a menu model which is not linked");
+        return;
+    }
+
+    detach(menu);
+    it->key = key;
+    it->submenus = submenus;
+    m_menusForKeys.insert(key, menu);
+}
+
+bool UnitySharedMenuModels::submenus(GMenu *menu, QVector<QPair<GMenu*, quint64>> &submenus) const
+{
+    auto it = m_entries.constFind(menu);
+    if (it == m_entries.constEnd() || it->key.isEmpty()) return false;
+
+    submenus = it->submenus;
+    return true;
+}
+
+void UnitySharedMenuModels::detach(GMenu *menu)
+{
+    auto it = m_entries.find(menu);
+    if (it == m_entries.end() || it->key.isEmpty()) return;
+
+    if (m_menusForKeys.value(it->key) == menu) {
+        m_menusForKeys.remove(it->key);
+    }
+    it->key.clear();
+    it->submenus.clear();
+}
+
+void UnitySharedMenuModels::ref(GMenu *menu)
+{
+    auto it = m_entries.find(menu);
+    if (it == m_entries.end()) {
+        g_object_ref(menu);
+        m_entries.insert(menu, Entry{QByteArray(), 1, QVector<QPair<GMenu*, quint64>>()});
+    } else {
+        it->links++;
+    }
+}
+
+void UnitySharedMenuModels::unref(GMenu *menu)
+{
+    auto it = m_entries.find(menu);
+    if (it == m_entries.end()) {
+        qCWarning(unityappmenu, "Trying to unlink a menu model which is not linked");
+        return;
+    }
+
+    if (--it->links == 0) {
+        detach(menu);
+        m_entries.erase(it);
+        g_object_unref(menu);
+    }
+}
+
+int UnitySharedMenuModels::links(GMenu *menu) const
+{
+    auto it = m_entries.constFind(menu);
+    return it == m_entries.constEnd() ? 0 : it->links;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_SHAREDMENUMODELS_H
+#define UNITY_SHAREDMENUMODELS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+#include <gio/gio.h>
+
+// Process wide book keeping of the submenu gmenus linked by the exporters.
+//
+// Every submenu gmenu an exporter links is reference counted here. Submenus built
+// from scratch are also registered under a hash of their content, so exporters of
+// structurally identical menus (e.g. the menubars of several document windows)
+// link the same gmenu instead of building and exporting their own copy.
+// A gmenu linked more than once must not be modified in place (copy on write).
+//
+// Shareable gmenus may be in use on the export thread, so what exporters linking them
+// need to know about them is recorded when they are built instead of read from them.
+class UnitySharedMenuModels
+{
+public:
+    static UnitySharedMenuModels *instance();
+
+    // Returns the shareable gmenu built for the given content hash, if any.
+    GMenu *lookup(const QByteArray &key) const;
+
+    // Register a newly built gmenu as shareable for the given content hash, along with
+    // the submenus it links depth first and their qtunity-tag.
+    void insert(const QByteArray &key, GMenu *menu, const QVector<QPair<GMenu*, quint64>> &submenus);
+
+    // The submenus linked by a shareable gmenu, as recorded by insert().
+    // Returns false if the gmenu is not shareable.
+    bool submenus(GMenu *menu, QVector<QPair<GMenu*, quint64>> &submenus) const;
+
+    // Drop the content hash of a gmenu which is about to be modified in place.
+    void detach(GMenu *menu);
+
+    void ref(GMenu *menu);
+    void unref(GMenu *menu);
+    int links(GMenu *menu) const;
+
+    // Number of gmenus linked by the exporters.
+    int count() const { return m_entries.count(); }
+
+private:
+    UnitySharedMenuModels() = default;
+
+    struct Entry {
+        QByteArray key;
+        int links;
+        QVector<QPair<GMenu*, quint64>> submenus;
+    };
+
+    QHash<QByteArray, GMenu*> m_menusForKeys;
+    QHash<GMenu*, Entry> m_entries;
+};
+
+#endif // UNITY_SHAREDMENUMODELS_H
@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "systemtrayicon.h"
+#include "gmenumodelexporter.h"
+#include "gmenumodelplatformmenu.h"
+#include "logging.h"
+#include "mainloopbridge.h"
+
+#include <QGuiApplication>
+#include <QImage>
+#include <QRect>
+#include <QtEndian>
+
+namespace {
+
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='org.kde.StatusNotifierItem'>"
+  "    <property name='Category' type='s' access='read'/>"
+  "    <property name='Id' type='s' access='read'/>"
+  "    <property name='Title' type='s' access='read'/>"
+  "    <property name='Status' type='s' access='read'/>"
+  "    <property name='IconName' type='s' access='read'/>"
+  "    <property name='IconPixmap' type='a(iiay)' access='read'/>"
+  "    <property name='ToolTip' type='(sa(iiay)ss)' access='read'/>"
+  "    <property name='ItemIsMenu' type='b' access='read'/>"
+  "    <property name='Menu' type='o' access='read'/>"
+  "    <method name='ContextMenu'>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "    </method>"
+  "    <method name='Activate'>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "    </method>"
+  "    <method name='SecondaryActivate'>"
+  "      <arg type='i' name='x' direction='in'/>"
+  "      <arg type='i' name='y' direction='in'/>"
+  "    </method>"
+  "    <method name='Scroll'>"
+  "      <arg type='i' name='delta' direction='in'/>"
+  "      <arg type='s' name='orientation' direction='in'/>"
+  "    </method>"
+  "    <signal name='NewTitle'/>"
+  "    <signal name='NewIcon'/>"
+  "    <signal name='NewToolTip'/>"
+  "    <signal name='NewStatus'>"
+  "      <arg type='s' name='status'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+#define ITEM_INTERFACE "org.kde.StatusNotifierItem"
+#define WATCHER_SERVICE "org.kde.StatusNotifierWatcher"
+#define ITEM_OBJECT_PATH "/io/unity8/StatusNotifierItem/%1"
+
+static uint s_itemId = 0;
+
+GDBusNodeInfo *introspection_data()
+{
+    static GDBusNodeInfo *data = g_dbus_node_info_new_for_xml(introspection_xml, nullptr);
+    return data;
+}
+
+static void handle_method_call (GDBusConnection       *,
+                                const gchar           *,
+                                const gchar           *,
+                                const gchar           *,
+                                const gchar           *method_name,
+                                GVariant              *,
+                                GDBusMethodInvocation *invocation,
+                                gpointer               user_data)
+{
+    auto tray = static_cast<UnitySystemTrayIcon*>(user_data);
+
+    if (g_strcmp0 (method_name, "Activate") == 0) {
+        tray->activate(QPlatformSystemTrayIcon::Trigger);
+    } else if (g_strcmp0 (method_name, "SecondaryActivate") == 0) {
+        tray->activate(QPlatformSystemTrayIcon::MiddleClick);
+    } else if (g_strcmp0 (method_name, "ContextMenu") == 0) {
+        tray->activate(QPlatformSystemTrayIcon::Context);
+    } else if (g_strcmp0 (method_name, "Scroll") != 0) {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Unknown method");
+        return;
+    }
+
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static GVariant *handle_get_property (GDBusConnection *,
+                                      const gchar     *,
+                                      const gchar     *,
+                                      const gchar     *,
+                                      const gchar     *property_name,
+                                      GError         **error,
+                                      gpointer         user_data)
+{
+    auto tray = static_cast<UnitySystemTrayIcon*>(user_data);
+
+    if (g_strcmp0 (property_name, "Category") == 0) {
+        return g_variant_new_string("ApplicationStatus");
+    } else if (g_strcmp0 (property_name, "Id") == 0) {
+        return g_variant_new_string(tray->id().toUtf8().constData());
+    } else if (g_strcmp0 (property_name, "Title") == 0) {
+        return g_variant_new_string(tray->title().toUtf8().constData());
+    } else if (g_strcmp0 (property_name, "Status") == 0) {
+        return g_variant_new_string("Active");
+    } else if (g_strcmp0 (property_name, "IconName") == 0) {
+        return g_variant_new_string(tray->iconName().toUtf8().constData());
+    } else if (g_strcmp0 (property_name, "IconPixmap") == 0) {
+        return tray->iconPixmap();
+    } else if (g_strcmp0 (property_name, "ToolTip") == 0) {
+        return tray->toolTip();
+    } else if (g_strcmp0 (property_name, "ItemIsMenu") == 0) {
+        return g_variant_new_boolean(FALSE);
+    } else if (g_strcmp0 (property_name, "Menu") == 0) {
+        return g_variant_new_object_path(tray->menuPath().toUtf8().constData());
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property %s", property_name);
+    return nullptr;
+}
+
+static const GDBusInterfaceVTable interface_vtable =
+{
+  handle_method_call,
+  handle_get_property,
+  NULL,
+  NULL
+};
+
+// Watches the StatusNotifierWatcher for the whole process. isSystemTrayAvailable() is asked
+// of short lived tray icons, so it reads the owner kept here instead of asking the bus.
+class UnityTrayWatcher
+{
+public:
+    static UnityTrayWatcher *instance()
+    {
+        static UnityTrayWatcher *watcher = new UnityTrayWatcher;
+        return watcher;
+    }
+
+    bool isAvailable() const { return m_available; }
+
+    void addIcon(UnitySystemTrayIcon *icon)
+    {
+        m_icons.append(icon);
+        if (m_available) icon->registerItem();
+    }
+    void removeIcon(UnitySystemTrayIcon *icon) { m_icons.removeAll(icon); }
+
+private:
+    UnityTrayWatcher();
+
+    static void appeared_cb(GDBusConnection *, const gchar *, const gchar *, gpointer user_data)
+    {
+        auto watcher = static_cast<UnityTrayWatcher*>(user_data);
+        if (watcher->m_available && !watcher->m_appeared) {
+            // Already known from the initial query, the icons registered when added
+            watcher->m_appeared = true;
+            return;
+        }
+        watcher->m_available = true;
+        watcher->m_appeared = true;
+        // Also called when the watcher is restarted, it doesn't know about us any more
+        Q_FOREACH(UnitySystemTrayIcon *icon, watcher->m_icons) {
+            icon->registerItem();
+        }
+    }
+
+    static void vanished_cb(GDBusConnection *, const gchar *, gpointer user_data)
+    {
+        auto watcher = static_cast<UnityTrayWatcher*>(user_data);
+        watcher->m_available = false;
+        watcher->m_appeared = true;
+    }
+
+    bool m_available;
+    // Whether the watch reported the owner yet
+    bool m_appeared;
+    QList<UnitySystemTrayIcon*> m_icons;
+};
+
+UnityTrayWatcher::UnityTrayWatcher()
+    : m_available(false)
+    , m_appeared(false)
+{
+    GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+    if (!connection) return;
+
+    // The watch reports the owner asynchronously, the first answer can't wait for it
+    GVariant *result = g_dbus_connection_call_sync(connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                   "org.freedesktop.DBus", "NameHasOwner",
+                                                   g_variant_new("(s)", WATCHER_SERVICE), G_VARIANT_TYPE("(b)"),
+                                                   G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    if (result) {
+        gboolean hasOwner = FALSE;
+        g_variant_get(result, "(b)", &hasOwner);
+        m_available = hasOwner;
+        g_variant_unref(result);
+    }
+
+    // The watcher calls dispatch on the default context
+    UnityMainLoopBridge::ensure();
+    g_bus_watch_name_on_connection(connection, WATCHER_SERVICE, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                   appeared_cb, vanished_cb, this, nullptr);
+    g_object_unref(connection);
+}
+
+static void register_item_cb(GObject *source, GAsyncResult *res, gpointer)
+{
+    GError *error = nullptr;
+    GVariant *result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+    if (result) {
+        g_variant_unref(result);
+    } else {
+        qCWarning(unityappmenu, "Failed to register the tray icon - %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+}
+
+} // namespace
+
+UnitySystemTrayIcon::UnitySystemTrayIcon()
+    : m_connection(nullptr)
+    , m_registrationId(0)
+    , m_watching(false)
+    , m_path(QStringLiteral(ITEM_OBJECT_PATH).arg(s_itemId++).toUtf8())
+{
+}
+
+UnitySystemTrayIcon::~UnitySystemTrayIcon()
+{
+    cleanup();
+}
+
+void UnitySystemTrayIcon::init()
+{
+    if (m_registrationId != 0) return;
+
+    // This is the connection the menus are exported on as well
+    GError *error = nullptr;
+    if (!m_connection) {
+        m_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+        if (!m_connection) {
+            qCWarning(unityappmenu, "Failed to retreive session bus - %s", error ? error->message : "unknown error");
+            g_clear_error(&error);
+            return;
+        }
+    }
+
+    // The item and the watcher calls dispatch on the default context
+    UnityMainLoopBridge::ensure();
+    m_registrationId = g_dbus_connection_register_object(m_connection, m_path.constData(),
+                                                         introspection_data()->interfaces[0],
+                                                         &interface_vtable,
+                                                         this,
+                                                         nullptr,
+                                                         &error);
+    if (!m_registrationId) {
+        qCWarning(unityappmenu, "Failed to export the tray icon - %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        return;
+    }
+
+    m_watching = true;
+    UnityTrayWatcher::instance()->addIcon(this);
+}
+
+void UnitySystemTrayIcon::cleanup()
+{
+    if (m_watching) {
+        UnityTrayWatcher::instance()->removeIcon(this);
+        m_watching = false;
+    }
+    if (m_registrationId != 0) {
+        g_dbus_connection_unregister_object(m_connection, m_registrationId);
+        m_registrationId = 0;
+    }
+    delete m_exporter.data();
+    g_clear_object(&m_connection);
+}
+
+void UnitySystemTrayIcon::registerItem()
+{
+    qCDebug(unityappmenu, "Registering tray icon %s", m_path.constData());
+
+    // The watcher takes the sender of the call as the service of the item
+    g_dbus_connection_call(m_connection, WATCHER_SERVICE, "/StatusNotifierWatcher", WATCHER_SERVICE,
+                           "RegisterStatusNotifierItem", g_variant_new("(s)", m_path.constData()),
+                           nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr, register_item_cb, nullptr);
+}
+
+void UnitySystemTrayIcon::emitSignal(const char *name)
+{
+    if (m_registrationId == 0) return;
+
+    g_dbus_connection_emit_signal(m_connection, nullptr, m_path.constData(), ITEM_INTERFACE, name, nullptr, nullptr);
+}
+
+void UnitySystemTrayIcon::updateIcon(const QIcon &icon)
+{
+    m_icon = icon;
+    emitSignal("NewIcon");
+}
+
+void UnitySystemTrayIcon::updateToolTip(const QString &tooltip)
+{
+    m_toolTip = tooltip;
+    emitSignal("NewToolTip");
+}
+
+// The context menu is exported like the context menus of the app, and gets the same
+// incremental updates.
+void UnitySystemTrayIcon::updateMenu(QPlatformMenu *menu)
+{
+    UnityPlatformMenu* gplatformMenu = static_cast<UnityPlatformMenu*>(menu);
+    if (m_exporter && m_exporter->parent() == gplatformMenu) return;
+
+    delete m_exporter.data();
+    if (gplatformMenu) {
+        m_exporter = new UnityMenuExporter(gplatformMenu);
+        m_exporter->exportModels();
+    }
+
+    if (m_registrationId == 0) return;
+
+    // There is no specific signal for the menu
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "Menu", g_variant_new_object_path(menuPath().toUtf8().constData()));
+    g_dbus_connection_emit_signal(m_connection, nullptr, m_path.constData(), "org.freedesktop.DBus.Properties",
+                                  "PropertiesChanged", g_variant_new("(sa{sv}as)", ITEM_INTERFACE, &builder, nullptr),
+                                  nullptr);
+}
+
+QRect UnitySystemTrayIcon::geometry() const
+{
+    return QRect();
+}
+
+void UnitySystemTrayIcon::showMessage(const QString &, const QString &, const QIcon &, MessageIcon, int)
+{
+    // Not supported, Qt shows its own balloon instead
+}
+
+bool UnitySystemTrayIcon::isSystemTrayAvailable() const
+{
+    return UnityTrayWatcher::instance()->isAvailable();
+}
+
+QPlatformMenu *UnitySystemTrayIcon::createMenu() const
+{
+    return new UnityPlatformMenu();
+}
+
+QString UnitySystemTrayIcon::id() const
+{
+    return QCoreApplication::applicationName();
+}
+
+QString UnitySystemTrayIcon::title() const
+{
+    return QGuiApplication::applicationDisplayName();
+}
+
+QString UnitySystemTrayIcon::iconName() const
+{
+    return m_icon.name();
+}
+
+QString UnitySystemTrayIcon::menuPath() const
+{
+    return m_exporter ? m_exporter->menuPath() : QStringLiteral("/NO_DBUSMENU");
+}
+
+// The pixmaps of the icon, as ARGB32 in network byte order.
+GVariant *UnitySystemTrayIcon::iconPixmap() const
+{
+    QList<QSize> sizes = m_icon.availableSizes();
+    if (sizes.isEmpty()) {
+        sizes << QSize(16, 16) << QSize(22, 22) << QSize(32, 32) << QSize(48, 48);
+    }
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(iiay)"));
+    Q_FOREACH(const QSize &size, sizes) {
+        const QImage image = m_icon.pixmap(size).toImage().convertToFormat(QImage::Format_ARGB32);
+        if (image.isNull()) continue;
+
+        QByteArray data(image.width() * image.height() * 4, Qt::Uninitialized);
+        quint32 *pixel = reinterpret_cast<quint32*>(data.data());
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < image.width(); ++x) {
+                *pixel++ = qToBigEndian<quint32>(line[x]);
+            }
+        }
+        g_variant_builder_add(&builder, "(ii@ay)", image.width(), image.height(),
+                              g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, data.constData(), data.size(), 1));
+    }
+    return g_variant_builder_end(&builder);
+}
+
+GVariant *UnitySystemTrayIcon::toolTip() const
+{
+    return g_variant_new("(sa(iiay)ss)", "", nullptr, m_toolTip.toUtf8().constData(), "");
+}
+
+void UnitySystemTrayIcon::activate(ActivationReason reason)
+{
+    Q_EMIT activated(reason);
+}
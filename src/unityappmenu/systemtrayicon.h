@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_SYSTEMTRAYICON_H
+#define UNITY_SYSTEMTRAYICON_H
+
+#include <qpa/qplatformsystemtrayicon.h>
+
+#include <QIcon>
+#include <QPointer>
+
+#include <gio/gio.h>
+
+class UnityGMenuModelExporter;
+
+// StatusNotifierItem tray icon. Its context menu is exported by a UnityMenuExporter
+// on the session bus connection of the exported menus, so it gets the same updates.
+class UnitySystemTrayIcon : public QPlatformSystemTrayIcon
+{
+    Q_OBJECT
+public:
+    UnitySystemTrayIcon();
+    ~UnitySystemTrayIcon();
+
+    void init() override;
+    void cleanup() override;
+    void updateIcon(const QIcon &icon) override;
+    void updateToolTip(const QString &tooltip) override;
+    void updateMenu(QPlatformMenu *menu) override;
+    QRect geometry() const override;
+    void showMessage(const QString &title, const QString &msg, const QIcon &icon,
+                     MessageIcon iconType, int msecs) override;
+
+    bool isSystemTrayAvailable() const override;
+    bool supportsMessages() const override { return false; }
+
+    QPlatformMenu *createMenu() const override;
+
+    // Used by the dbus object of the item
+    QString id() const;
+    QString title() const;
+    QString iconName() const;
+    QString menuPath() const;
+    GVariant *iconPixmap() const;
+    GVariant *toolTip() const;
+    void activate(ActivationReason reason);
+    void registerItem();
+
+private:
+    void emitSignal(const char *name);
+
+    GDBusConnection *m_connection;
+    guint m_registrationId;
+    // Registered with the StatusNotifierWatcher whenever it shows up
+    bool m_watching;
+    QByteArray m_path;
+    QIcon m_icon;
+    QString m_toolTip;
+    // Owned, but deleted along with its platform menu
+    QPointer<UnityGMenuModelExporter> m_exporter;
+};
+
+#endif // UNITY_SYSTEMTRAYICON_H
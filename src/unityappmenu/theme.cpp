@@ -16,12 +16,15 @@
 
 #include "theme.h"
 #include "gmenumodelplatformmenu.h"
+#include "systemtrayicon.h"
+#include "registry.h"
 #include "logging.h"
 
 #include <QtCore/QVariant>
 #include <QDebug>
 
 Q_LOGGING_CATEGORY(unityappmenu, "unityappmenu", QtWarningMsg)
+Q_LOGGING_CATEGORY(unityappmenuTiming, "unityappmenu.timing", QtWarningMsg)
 const char *UnityAppMenuTheme::name = "unityappmenu";
 
 namespace {
@@ -32,11 +35,23 @@ bool useLocalMenu() {
     return menuProxyIsZero;
 }
 
+QElapsedTimer &startupTimer()
+{
+    static QElapsedTimer timer;
+    return timer;
+}
+
+}
+
+const QElapsedTimer &unityappmenuStartupTimer()
+{
+    return startupTimer();
 }
 
 UnityAppMenuTheme::UnityAppMenuTheme():
     UnityTheme()
 {
+    startupTimer().start();
     qCDebug(unityappmenu, "UnityAppMenuTheme::UnityAppMenuTheme() - useLocalMenu=%s", useLocalMenu() ? "true" : "false");
 }
 
@@ -62,6 +77,10 @@ QPlatformSystemTrayIcon *UnityAppMenuTheme::createPlatformSystemTrayIcon() const
 {
     // We can't use QGenericUnixTheme implementation since it needs the platformMenu to
     // be a subclass of QDBusPlatformMenu and ours isn't
-    // TODO Investigate if we're fine with not supporting system trays or we should fix it
-    return nullptr;
+    if (useLocalMenu()) return QGenericUnixTheme::createPlatformSystemTrayIcon();
+    // Our items point at an org.gtk.Menus menu, not a com.canonical.dbusmenu one. Only the
+    // shell reading the app menus from the registrar reads those, elsewhere Qt falls back
+    // to its own tray.
+    if (!UnityMenuRegistry::instance()->isConnected()) return nullptr;
+    return new UnitySystemTrayIcon();
 }
@@ -0,0 +1,48 @@
+# The sources of the platform theme, shared by the plugin and the programs
+# testing the exporters, which can't link to the plugin's hidden symbols.
+
+QT += core-private theme_support-private dbus
+
+CONFIG += link_pkgconfig
+PKGCONFIG += gio-2.0 gio-unix-2.0
+
+INCLUDEPATH += $$PWD
+
+# ApplyMenuRegistrations() takes the UnityMenuRegistration type of registry.h
+registrar_interface.files = $$PWD/io.unity8.MenuRegistrar.xml
+registrar_interface.header_flags = -i registry.h
+DBUS_INTERFACES += registrar_interface
+
+HEADERS += \
+    $$PWD/theme.h \
+    $$PWD/exportthread.h \
+    $$PWD/gmenumodelexporter.h \
+    $$PWD/gmenumodelplatformmenu.h \
+    $$PWD/logging.h \
+    $$PWD/mainloopbridge.h \
+    $$PWD/menuactiongroup.h \
+    $$PWD/menulayoutbuffer.h \
+    $$PWD/menusearchindex.h \
+    $$PWD/menutrace.h \
+    $$PWD/menuregistrar.h \
+    $$PWD/registry.h \
+    $$PWD/sharedmenumodels.h \
+    $$PWD/systemtrayicon.h \
+    $$PWD/qtunityextraactionhandler.h \
+    $$PWD/../shared/unitytheme.h
+
+SOURCES += \
+    $$PWD/theme.cpp \
+    $$PWD/exportthread.cpp \
+    $$PWD/gmenumodelexporter.cpp \
+    $$PWD/gmenumodelplatformmenu.cpp \
+    $$PWD/mainloopbridge.cpp \
+    $$PWD/menuactiongroup.cpp \
+    $$PWD/menulayoutbuffer.cpp \
+    $$PWD/menusearchindex.cpp \
+    $$PWD/menutrace.cpp \
+    $$PWD/menuregistrar.cpp \
+    $$PWD/registry.cpp \
+    $$PWD/sharedmenumodels.cpp \
+    $$PWD/systemtrayicon.cpp \
+    $$PWD/qtunityextraactionhandler.cpp
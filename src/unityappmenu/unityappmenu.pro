@@ -2,7 +2,6 @@ TARGET = unityappmenu
 TEMPLATE = lib
 
 QT -= gui
-QT += core-private theme_support-private dbus
 
 CONFIG += plugin no_keywords
 
@@ -10,30 +9,13 @@ CONFIG += plugin no_keywords
 QMAKE_CXXFLAGS += -fvisibility=hidden -fvisibility-inlines-hidden -std=c++11 -Werror -Wall
 QMAKE_LFLAGS += -std=c++11 -Wl,-no-undefined
 
-CONFIG += link_pkgconfig
-PKGCONFIG += gio-2.0
-
-DBUS_INTERFACES += io.unity8.MenuRegistrar.xml
+include(unityappmenu.pri)
 
 HEADERS += \
-    theme.h \
-    gmenumodelexporter.h \
-    gmenumodelplatformmenu.h \
-    logging.h \
-    menuregistrar.h \
-    registry.h \
-    themeplugin.h \
-    qtunityextraactionhandler.h \
-    ../shared/unitytheme.h
+    themeplugin.h
 
 SOURCES += \
-    theme.cpp \
-    gmenumodelexporter.cpp \
-    gmenumodelplatformmenu.cpp \
-    menuregistrar.cpp \
-    registry.cpp \
-    themeplugin.cpp \
-    qtunityextraactionhandler.cpp
+    themeplugin.cpp
 
 OTHER_FILES += \
     unityappmenu.json
@@ -0,0 +1,15 @@
+# Helpers shared by the test programs: a stand-in io.unity8.MenuRegistrar on the test
+# bus, and running the Qt and GLib event loops until the exporter is done.
+
+CONFIG += link_pkgconfig
+PKGCONFIG += gio-2.0
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/eventloop.h \
+    $$PWD/standinregistrar.h
+
+SOURCES += \
+    $$PWD/eventloop.cpp \
+    $$PWD/standinregistrar.cpp
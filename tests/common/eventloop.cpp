@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "eventloop.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <gio/gio.h>
+
+namespace {
+
+// In case Qt doesn't iterate the default GMainContext
+void iterateMainContext()
+{
+    while (g_main_context_iteration(nullptr, FALSE)) {}
+}
+
+} // namespace
+
+void flush()
+{
+    QCoreApplication::processEvents();
+    QCoreApplication::processEvents();
+    iterateMainContext();
+}
+
+bool waitFor(const std::function<bool()> &condition, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.hasExpired(timeout)) return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        iterateMainContext();
+    }
+    return true;
+}
+
+void settle()
+{
+    waitFor([]() { return false; }, 200);
+}
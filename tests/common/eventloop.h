@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_TEST_EVENTLOOP_H
+#define UNITY_TEST_EVENTLOOP_H
+
+#include <functional>
+
+// Lets the exporter flush its updates, zero interval timers fire on the next iteration
+void flush();
+
+// Runs the event loops until the condition holds, false when it didn't within the timeout
+bool waitFor(const std::function<bool()> &condition, int timeout = 5000);
+
+// Lets the calls which shouldn't come arrive
+void settle();
+
+#endif // UNITY_TEST_EVENTLOOP_H
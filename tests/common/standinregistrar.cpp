@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "standinregistrar.h"
+
+namespace {
+
+const char registrarXml[] =
+    "<node>"
+    "  <interface name='io.unity8.MenuRegistrar'>"
+    "    <method name='RegisterAppMenu'>"
+    "      <arg type='u' direction='in'/><arg type='o' direction='in'/>"
+    "      <arg type='o' direction='in'/><arg type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='UnregisterAppMenu'>"
+    "      <arg type='u' direction='in'/><arg type='o' direction='in'/>"
+    "    </method>"
+    "    <method name='RegisterSurfaceMenu'>"
+    "      <arg type='s' direction='in'/><arg type='o' direction='in'/>"
+    "      <arg type='o' direction='in'/><arg type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='UnregisterSurfaceMenu'>"
+    "      <arg type='s' direction='in'/><arg type='o' direction='in'/>"
+    "    </method>"
+    "    %1"
+    "  </interface>"
+    "</node>";
+
+const char batchMethodXml[] =
+    "<method name='ApplyMenuRegistrations'>"
+    "  <arg type='a(bsuoos)' direction='in'/>"
+    "</method>";
+
+} // namespace
+
+StandInRegistrar::StandInRegistrar(const gchar *address, Mode mode)
+    : m_mode(mode)
+    , m_connection(nullptr)
+    , m_objectId(0)
+{
+    GError *error = nullptr;
+    m_connection = g_dbus_connection_new_for_address_sync(address, static_cast<GDBusConnectionFlags>(
+                                                              G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                              G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+                                                          nullptr, nullptr, &error);
+    if (!m_connection) {
+        qFatal("Failed to connect to the test bus - %s", error->message);
+    }
+
+    const QByteArray xml = QString::fromLatin1(registrarXml).arg(QLatin1String(mode == NoBatches ? "" : batchMethodXml)).toLatin1();
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(xml.constData(), nullptr);
+    static const GDBusInterfaceVTable vtable = { methodCall, nullptr, nullptr, { nullptr } };
+    m_objectId = g_dbus_connection_register_object(m_connection, "/io/unity8/MenuRegistrar", info->interfaces[0],
+                                                   &vtable, this, nullptr, nullptr);
+    g_dbus_node_info_unref(info);
+
+    GVariant *reply = g_dbus_connection_call_sync(m_connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                  "org.freedesktop.DBus", "RequestName",
+                                                  g_variant_new("(su)", "io.unity8.MenuRegistrar", 4 /* DO_NOT_QUEUE */),
+                                                  G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (!reply) {
+        qFatal("Failed to own the registrar name - %s", error->message);
+    }
+    g_variant_unref(reply);
+}
+
+StandInRegistrar::~StandInRegistrar()
+{
+    // Never answered
+    Q_FOREACH(GDBusMethodInvocation *invocation, m_heldInvocations) {
+        g_object_unref(invocation);
+    }
+    g_dbus_connection_unregister_object(m_connection, m_objectId);
+    g_dbus_connection_close_sync(m_connection, nullptr, nullptr);
+    g_object_unref(m_connection);
+}
+
+void StandInRegistrar::releaseName()
+{
+    GVariant *reply = g_dbus_connection_call_sync(m_connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                  "org.freedesktop.DBus", "ReleaseName",
+                                                  g_variant_new("(s)", "io.unity8.MenuRegistrar"),
+                                                  G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    if (reply) {
+        g_variant_unref(reply);
+    }
+}
+
+void StandInRegistrar::answerHeldBatches(const gchar *errorName)
+{
+    Q_FOREACH(GDBusMethodInvocation *invocation, m_heldInvocations) {
+        g_dbus_method_invocation_return_dbus_error(invocation, errorName, "Answered late");
+    }
+    m_heldInvocations.clear();
+}
+
+void StandInRegistrar::apply(bool add, const gchar *surface, guint pid, const gchar *path, const gchar *service)
+{
+    const QString key = QStringLiteral("%1 %2").arg(*surface ? QString::fromUtf8(surface) : QString::number(pid))
+                                               .arg(QString::fromUtf8(path));
+    if (add) {
+        registrations.insert(key);
+        if (menuRegistered) {
+            menuRegistered(service, path);
+        }
+    } else {
+        registrations.remove(key);
+    }
+}
+
+void StandInRegistrar::methodCall(GDBusConnection *, const gchar *, const gchar *, const gchar *, const gchar *method,
+                                  GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data)
+{
+    auto registrar = static_cast<StandInRegistrar*>(user_data);
+    const gchar *surface = "";
+    const gchar *path = nullptr;
+    const gchar *service = nullptr;
+    guint pid = 0;
+
+    if (g_strcmp0(method, "ApplyMenuRegistrations") == 0) {
+        registrar->batchCalls++;
+        if (registrar->m_mode == HoldBatches) {
+            // Answering later consumes the invocation, like answering now
+            registrar->m_heldInvocations.append(invocation);
+            return;
+        }
+        if (registrar->m_mode == FailFirstBatch && registrar->batchCalls == 1) {
+            g_dbus_method_invocation_return_dbus_error(invocation, "org.freedesktop.DBus.Error.Failed", "Not now");
+            return;
+        }
+
+        GVariantIter *iter = nullptr;
+        gboolean add;
+        g_variant_get(parameters, "(a(bsuoos))", &iter);
+        while (g_variant_iter_next(iter, "(b&su&o&o&s)", &add, &surface, &pid, &path, nullptr, &service)) {
+            registrar->apply(add, surface, pid, path, service);
+        }
+        g_variant_iter_free(iter);
+    } else {
+        registrar->singleCalls++;
+        if (g_strcmp0(method, "RegisterAppMenu") == 0) {
+            g_variant_get(parameters, "(u&o&o&s)", &pid, &path, nullptr, &service);
+            registrar->apply(true, surface, pid, path, service);
+        } else if (g_strcmp0(method, "UnregisterAppMenu") == 0) {
+            g_variant_get(parameters, "(u&o)", &pid, &path);
+            registrar->apply(false, surface, pid, path, service);
+        } else if (g_strcmp0(method, "RegisterSurfaceMenu") == 0) {
+            g_variant_get(parameters, "(&s&o&o&s)", &surface, &path, nullptr, &service);
+            registrar->apply(true, surface, pid, path, service);
+        } else {
+            g_variant_get(parameters, "(&s&o)", &surface, &path);
+            registrar->apply(false, surface, pid, path, service);
+        }
+    }
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+}
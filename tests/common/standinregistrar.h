@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_TEST_STANDINREGISTRAR_H
+#define UNITY_TEST_STANDINREGISTRAR_H
+
+#include <QList>
+#include <QSet>
+#include <QString>
+
+#include <gio/gio.h>
+
+#include <functional>
+
+// A registrar owning io.unity8.MenuRegistrar on a connection of its own, keeping the
+// registered menus as "pid path" or "surface path".
+class StandInRegistrar
+{
+public:
+    enum Mode {
+        // Without ApplyMenuRegistrations
+        NoBatches,
+        Batches,
+        // Fails the first batch with a generic error
+        FailFirstBatch,
+        // Doesn't answer batches until answerHeldBatches()
+        HoldBatches
+    };
+
+    StandInRegistrar(const gchar *address, Mode mode = Batches);
+    ~StandInRegistrar();
+
+    GDBusConnection *connection() const { return m_connection; }
+
+    void releaseName();
+    void answerHeldBatches(const gchar *errorName);
+
+    QSet<QString> registrations;
+    int batchCalls = 0;
+    int singleCalls = 0;
+
+    // Called for every menu registered, with the service and the object path of the menu
+    std::function<void(const gchar *service, const gchar *path)> menuRegistered;
+
+private:
+    static void methodCall(GDBusConnection *connection, const gchar *sender, const gchar *path, const gchar *interface,
+                           const gchar *method, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data);
+    void apply(bool add, const gchar *surface, guint pid, const gchar *path, const gchar *service);
+
+    const Mode m_mode;
+    GDBusConnection *m_connection;
+    guint m_objectId;
+    QList<GDBusMethodInvocation*> m_heldInvocations;
+};
+
+#endif // UNITY_TEST_STANDINREGISTRAR_H
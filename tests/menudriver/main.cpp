@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Applies random mutations to the platform menus of a menubar, with the exporter checking
+// its models against them after every update (QTUNITY_MENU_VERIFY). Fails when an exported
+// model doesn't match its platform menu. Runs on a private bus of its own.
+
+#include "menudriver.h"
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QEventLoop>
+#include <QGuiApplication>
+#include <QLoggingCategory>
+#include <QTimer>
+
+#include <gio/gio.h>
+
+namespace {
+
+QAtomicInt s_mismatches;
+QtMessageHandler s_defaultHandler = nullptr;
+
+void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (type == QtWarningMsg && qstrcmp(context.category, "unityappmenu") == 0 &&
+            message.startsWith(QLatin1String("Exported menu"))) {
+        s_mismatches.ref();
+    }
+    s_defaultHandler(type, context, message);
+}
+
+// Let the exporter flush its updates, and check them
+void settle()
+{
+    QEventLoop loop;
+    QTimer::singleShot(5, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Set before anything reads them
+    qputenv("QTUNITY_MENU_VERIFY", "1");
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("unity-menu-driver"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Applies random mutations to exported menus and checks "
+                                                    "the exported models after every update."));
+    parser.addHelpOption();
+    QCommandLineOption seedOption(QStringLiteral("seed"), QStringLiteral("Seed of the mutations."), QStringLiteral("seed"));
+    QCommandLineOption mutationsOption(QStringLiteral("mutations"), QStringLiteral("Number of mutations, 20000 by default."),
+                                       QStringLiteral("count"), QStringLiteral("20000"));
+    QCommandLineOption batchOption(QStringLiteral("batch"),
+                                   QStringLiteral("Mutations applied within one event loop iteration, 8 by default."),
+                                   QStringLiteral("count"), QStringLiteral("8"));
+    parser.addOption(seedOption);
+    parser.addOption(mutationsOption);
+    parser.addOption(batchOption);
+    parser.process(app);
+
+    // The mutation rate and the model signals per mutation are logged along with the checks
+    QLoggingCategory::setFilterRules(QStringLiteral("unityappmenu.timing.debug=true"));
+    s_defaultHandler = qInstallMessageHandler(messageHandler);
+
+    const quint32 seed = parser.isSet(seedOption) ? parser.value(seedOption).toUInt()
+                                                  : static_cast<quint32>(QDateTime::currentMSecsSinceEpoch());
+    const int mutations = parser.value(mutationsOption).toInt();
+    const int batch = qMax(parser.value(batchOption).toInt(), 1);
+    qInfo("seed %u", seed);
+
+    {
+        MenuDriver driver(seed);
+        driver.populate(6);
+        settle();
+        for (int i = 0; i < mutations; ++i) {
+            driver.mutate();
+            if ((i + 1) % batch == 0) {
+                settle();
+            }
+        }
+        settle();
+    }
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    if (s_mismatches.load() != 0) {
+        qWarning("%d exported models didn't match their platform menus, seed %u", s_mismatches.load(), seed);
+        return 1;
+    }
+    return 0;
+}
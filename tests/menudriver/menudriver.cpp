@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "menudriver.h"
+
+MenuDriver::~MenuDriver()
+{
+    Q_FOREACH(QPlatformMenu *menu, m_bar.menus()) {
+        m_bar.removeMenu(menu);
+        destroyMenu(static_cast<UnityPlatformMenu*>(menu));
+    }
+}
+
+void MenuDriver::populate(int menus)
+{
+    for (int i = 0; i < menus; ++i) {
+        UnityPlatformMenu *menu = createMenu(0);
+        menu->setText(QStringLiteral("Menu %1").arg(i));
+        m_bar.insertMenu(menu, nullptr);
+    }
+}
+
+// Labels are picked from a few only, so identical submenus and duplicate actions come up.
+UnityPlatformMenuItem *MenuDriver::createItem(int depth)
+{
+    auto item = new UnityPlatformMenuItem;
+    m_itemCount++;
+    const int kind = random(10);
+    if (kind == 0) {
+        item->setIsSeparator(true);
+        return item;
+    }
+
+    item->setText(QStringLiteral("Item %1").arg(random(8)));
+    item->setEnabled(!chance(10));
+    item->setVisible(!chance(10));
+    if (kind == 1 && depth < 3) {
+        item->setMenu(createMenu(depth + 1));
+    } else if (kind <= 4) {
+        item->setCheckable(true);
+        item->setChecked(chance(50));
+        item->setHasExclusiveGroup(kind <= 3);
+    } else if (kind == 5) {
+        item->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_A + random(26)));
+    }
+    return item;
+}
+
+UnityPlatformMenu *MenuDriver::createMenu(int depth)
+{
+    auto menu = new UnityPlatformMenu;
+    m_menus.append(menu);
+    const int count = random(depth == 0 ? 12 : 6);
+    for (int i = 0; i < count; ++i) {
+        menu->insertMenuItem(createItem(depth), nullptr);
+    }
+    return menu;
+}
+
+void MenuDriver::destroyItem(UnityPlatformMenuItem *item)
+{
+    UnityPlatformMenu *submenu = static_cast<UnityPlatformMenu*>(item->menu());
+    delete item;
+    m_itemCount--;
+    if (submenu) {
+        destroyMenu(submenu);
+    }
+}
+
+void MenuDriver::destroyMenu(UnityPlatformMenu *menu)
+{
+    m_menus.removeOne(menu);
+    const QList<QPlatformMenuItem*> items = menu->menuItems();
+    delete menu;
+    Q_FOREACH(QPlatformMenuItem *item, items) {
+        destroyItem(static_cast<UnityPlatformMenuItem*>(item));
+    }
+}
+
+UnityPlatformMenu *MenuDriver::randomMenu()
+{
+    return m_menus.isEmpty() ? nullptr : m_menus.at(random(m_menus.count()));
+}
+
+UnityPlatformMenuItem *MenuDriver::randomItem(UnityPlatformMenu **menu)
+{
+    *menu = randomMenu();
+    if (!*menu || (*menu)->menuItems().isEmpty()) return nullptr;
+
+    const QList<QPlatformMenuItem*> items = (*menu)->menuItems();
+    return static_cast<UnityPlatformMenuItem*>(items.at(random(items.count())));
+}
+
+// Apply one of the changes the exporter follows. The platform menus don't report text changes
+// of existing items, see UnityPlatformMenu::syncMenuItem(), new labels come with new items.
+void MenuDriver::mutate()
+{
+    UnityPlatformMenu *menu = nullptr;
+    UnityPlatformMenuItem *item = randomItem(&menu);
+
+    const bool full = m_itemLimit >= 0 && m_itemCount >= m_itemLimit;
+    int change = random(10);
+    if (full && change <= 1) {
+        change = 2;
+    }
+
+    switch (change) {
+    case 0:
+    case 1:
+        if (menu) {
+            const QList<QPlatformMenuItem*> items = menu->menuItems();
+            QPlatformMenuItem *before = items.value(random(items.count() + 1));
+            // Nesting is bounded by the depth of the new submenus only
+            menu->insertMenuItem(createItem(2), before);
+        }
+        break;
+    case 2:
+        if (item) {
+            menu->removeMenuItem(item);
+            destroyItem(item);
+        }
+        break;
+    case 3:
+        if (item) item->setEnabled(chance(80));
+        break;
+    case 4:
+        if (item) item->setChecked(chance(50));
+        break;
+    case 5:
+        if (item) item->setVisible(chance(80));
+        break;
+    case 6:
+        if (menu) menu->setVisible(chance(80));
+        break;
+    case 7:
+        if (menu) menu->syncSeparatorsCollapsible(chance(50));
+        break;
+    case 8:
+        if (!m_bar.menus().isEmpty() && (full || chance(50))) {
+            const QList<QPlatformMenu*> menus = m_bar.menus();
+            QPlatformMenu *topLevelMenu = menus.at(random(menus.count()));
+            m_bar.removeMenu(topLevelMenu);
+            destroyMenu(static_cast<UnityPlatformMenu*>(topLevelMenu));
+        } else {
+            UnityPlatformMenu *topLevelMenu = createMenu(0);
+            topLevelMenu->setText(QStringLiteral("Menu %1").arg(random(8)));
+            const QList<QPlatformMenu*> menus = m_bar.menus();
+            m_bar.insertMenu(topLevelMenu, menus.value(random(menus.count() + 1)));
+        }
+        break;
+    case 9:
+        if (item) item->setHasExclusiveGroup(chance(50));
+        break;
+    }
+}
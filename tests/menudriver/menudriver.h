@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_MENUDRIVER_H
+#define UNITY_MENUDRIVER_H
+
+#include "gmenumodelplatformmenu.h"
+
+#include <QList>
+
+#include <random>
+
+// Applies random mutations to the platform menus of a menubar.
+class MenuDriver
+{
+public:
+    explicit MenuDriver(quint32 seed) : m_random(seed) {}
+    ~MenuDriver();
+
+    UnityPlatformMenuBar *bar() { return &m_bar; }
+
+    // Beyond this many items, items are removed instead of inserted. Unlimited by default.
+    void setItemLimit(int limit) { m_itemLimit = limit; }
+    int itemCount() const { return m_itemCount; }
+
+    void populate(int menus);
+    void mutate();
+    UnityPlatformMenu *randomMenu();
+
+private:
+    int random(int bound) { return std::uniform_int_distribution<int>(0, bound - 1)(m_random); }
+    bool chance(int percent) { return random(100) < percent; }
+
+    UnityPlatformMenu *createMenu(int depth);
+    UnityPlatformMenuItem *createItem(int depth);
+    void destroyItem(UnityPlatformMenuItem *item);
+    void destroyMenu(UnityPlatformMenu *menu);
+    UnityPlatformMenuItem *randomItem(UnityPlatformMenu **menu);
+
+    std::mt19937 m_random;
+    UnityPlatformMenuBar m_bar;
+    // Every live menu, the top level ones included
+    QList<UnityPlatformMenu*> m_menus;
+    int m_itemLimit = -1;
+    int m_itemCount = 0;
+};
+
+#endif // UNITY_MENUDRIVER_H
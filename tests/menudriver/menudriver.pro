@@ -0,0 +1,14 @@
+TARGET = unity-menu-driver
+TEMPLATE = app
+
+QT += gui
+
+CONFIG += console no_keywords
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++11 -Werror -Wall
+
+include(../../src/unityappmenu/unityappmenu.pri)
+
+HEADERS += menudriver.h
+SOURCES += main.cpp menudriver.cpp
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Registers menus with stand-in registrars on a private bus, and checks that they are
+// registered again when the registrar changes owner, with or without batch support. Then
+// times registering them again as the window count grows.
+
+#include "eventloop.h"
+#include "menuregistrar.h"
+#include "standinregistrar.h"
+
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QScopedPointer>
+#include <QWindow>
+
+namespace {
+
+int s_failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (condition) {
+        qInfo("PASS: %s", what);
+    } else {
+        qWarning("FAIL: %s", what);
+        s_failures++;
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+    const gchar *address = g_test_dbus_get_bus_address(bus);
+
+    {
+        QGuiApplication app(argc, argv);
+
+        QScopedPointer<StandInRegistrar> registrar(new StandInRegistrar(address, StandInRegistrar::Batches));
+        QList<QWindow*> windows;
+        QList<UnityMenuRegistrar*> menuRegistrars;
+        auto addMenus = [&windows, &menuRegistrars](int count) {
+            for (int i = 0; i < count; ++i) {
+                windows.append(new QWindow);
+                menuRegistrars.append(new UnityMenuRegistrar);
+                menuRegistrars.last()->registerMenuForWindow(windows.last(),
+                                                             QDBusObjectPath(QStringLiteral("/test/menu/%1").arg(windows.count())));
+            }
+        };
+        auto registered = [&registrar, &menuRegistrars]() {
+            return registrar->registrations.count() == menuRegistrars.count();
+        };
+
+        addMenus(3);
+        check(waitFor(registered), "menus registered with the first registrar");
+        check(registrar->batchCalls == 1 && registrar->singleCalls == 0, "menus registered in one batch");
+
+        registrar.reset();
+        registrar.reset(new StandInRegistrar(address, StandInRegistrar::NoBatches));
+        check(waitFor(registered), "menus registered again with a registrar without batches");
+
+        registrar.reset();
+        registrar.reset(new StandInRegistrar(address, StandInRegistrar::FailFirstBatch));
+        check(waitFor(registered), "menus registered one by one after a failed batch");
+        addMenus(2);
+        check(waitFor(registered) && registrar->batchCalls == 2, "batches sent again after a failure other than a missing method");
+
+        // The owner goes away while the batch probe awaits its reply
+        registrar.reset();
+        registrar.reset(new StandInRegistrar(address, StandInRegistrar::HoldBatches));
+        check(waitFor([&registrar]() { return registrar->batchCalls == 1; }), "batch probe held by the registrar");
+
+        QScopedPointer<StandInRegistrar> previousRegistrar(registrar.take());
+        previousRegistrar->releaseName();
+        registrar.reset(new StandInRegistrar(address, StandInRegistrar::Batches));
+        check(waitFor(registered), "menus registered with the new owner while the previous one holds the probe");
+        previousRegistrar->answerHeldBatches("org.freedesktop.DBus.Error.UnknownMethod");
+        settle();
+        check(registered() && registrar->singleCalls == 0, "the reply of the previous owner is ignored");
+        previousRegistrar.reset();
+
+        addMenus(2);
+        check(waitFor(registered) && registrar->singleCalls == 0, "menus still registered in batches");
+
+        // Times registering the menus again with a new owner as the window count grows
+        const int windowCounts[] = { 10, 50, 200 };
+        const StandInRegistrar::Mode modes[] = { StandInRegistrar::Batches, StandInRegistrar::NoBatches };
+        for (int windowCount : windowCounts) {
+            addMenus(windowCount - menuRegistrars.count());
+            for (StandInRegistrar::Mode mode : modes) {
+                registrar.reset();
+                QElapsedTimer timer;
+                timer.start();
+                registrar.reset(new StandInRegistrar(address, mode));
+                const bool done = waitFor(registered, 30000);
+                const qint64 elapsed = timer.elapsed();
+                check(done, "menus registered again with the new owner");
+                qInfo("%d windows, %s registrar: %d calls, %lld ms", windowCount,
+                      mode == StandInRegistrar::Batches ? "batched" : "single call",
+                      registrar->batchCalls + registrar->singleCalls, elapsed);
+            }
+        }
+
+        qDeleteAll(menuRegistrars);
+        check(waitFor([&registrar]() { return registrar->registrations.isEmpty(); }), "menus unregistered");
+        qDeleteAll(windows);
+        registrar.reset();
+    }
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    if (s_failures != 0) {
+        qWarning("%d checks failed", s_failures);
+        return 1;
+    }
+    return 0;
+}
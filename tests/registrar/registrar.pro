@@ -0,0 +1,14 @@
+TARGET = unity-menu-registrar-test
+TEMPLATE = app
+
+QT += gui
+
+CONFIG += console no_keywords
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++11 -Werror -Wall
+
+include(../../src/unityappmenu/unityappmenu.pri)
+include(../common/common.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Applies millions of random mutations to the menus of a bounded menubar, and shows and
+// dismisses popups of them, while sampling the live counts the exporter publishes with
+// getStatistics. Fails when a count keeps growing although the menus don't. Runs on a
+// private bus of its own.
+
+#include "eventloop.h"
+#include "menudriver.h"
+
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QMap>
+#include <QVector>
+#include <QWindow>
+
+#include <gio/gio.h>
+
+#include <unistd.h>
+
+namespace {
+
+void statisticsReply(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    GError *error = nullptr;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+    if (!reply) {
+        qWarning("getStatistics failed - %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        // Not null, so the wait ends
+        reply = g_variant_ref_sink(g_variant_new("(a{sv})", nullptr));
+    }
+    *static_cast<GVariant**>(user_data) = reply;
+}
+
+// Asks the exporter for its live counts over the bus, like an external monitor would.
+// The exporter answers on the gui thread, so the call can't block it.
+QMap<QString, qint64> fetchStatistics(GDBusConnection *connection, const gchar *service, const QByteArray &path)
+{
+    GVariant *reply = nullptr;
+    g_dbus_connection_call(connection, service, path.constData(), "qtunity.actions.extra", "getStatistics",
+                           nullptr, G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr,
+                           statisticsReply, &reply);
+    QMap<QString, qint64> counts;
+    if (!waitFor([&reply]() { return reply != nullptr; })) {
+        qWarning("getStatistics didn't answer");
+        return counts;
+    }
+
+    GVariantIter *iter = nullptr;
+    const gchar *key = nullptr;
+    GVariant *value = nullptr;
+    g_variant_get(reply, "(a{sv})", &iter);
+    while (g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
+        if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT32)) {
+            counts.insert(QString::fromUtf8(key), g_variant_get_int32(value));
+        } else if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT64)) {
+            counts.insert(QString::fromUtf8(key), g_variant_get_int64(value));
+        }
+    }
+    g_variant_iter_free(iter);
+    g_variant_unref(reply);
+    return counts;
+}
+
+// A count grows without bound when even its lowest samples of the last third are above all
+// of those of the first third. The RSS may move a little with the heap layout.
+bool keepsGrowing(const QString &key, const QVector<qint64> &samples)
+{
+    const int third = samples.count() / 3;
+    if (third == 0) return false;
+
+    qint64 firstMax = samples.at(0);
+    for (int i = 1; i < third; ++i) {
+        firstMax = qMax(firstMax, samples.at(i));
+    }
+    qint64 lastMin = samples.last();
+    for (int i = samples.count() - third; i < samples.count(); ++i) {
+        lastMin = qMin(lastMin, samples.at(i));
+    }
+    const qint64 slack = key == QLatin1String("processRss") ? 4096 : 0;
+    return lastMin > firstMax + slack;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // GObject reads GOBJECT_DEBUG when it is loaded, so the instances are only counted
+    // when it is set for the whole process
+    const QByteArray gobjectDebug = qgetenv("GOBJECT_DEBUG");
+    if (!gobjectDebug.contains("instance-count")) {
+        qputenv("GOBJECT_DEBUG", gobjectDebug.isEmpty() ? QByteArray("instance-count") : gobjectDebug + ":instance-count");
+        execv("/proc/self/exe", argv);
+        qWarning("Failed to restart with GOBJECT_DEBUG set, the GObjects aren't counted");
+    }
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    int result = 0;
+    {
+        QGuiApplication app(argc, argv);
+        QCoreApplication::setApplicationName(QStringLiteral("unity-menu-soak"));
+
+        QCommandLineParser parser;
+        parser.setApplicationDescription(QStringLiteral("Applies random mutations and popups to exported menus, and fails "
+                                                        "when the live counts of the exporter keep growing."));
+        parser.addHelpOption();
+        QCommandLineOption seedOption(QStringLiteral("seed"), QStringLiteral("Seed of the mutations."), QStringLiteral("seed"));
+        QCommandLineOption mutationsOption(QStringLiteral("mutations"), QStringLiteral("Number of mutations, 2000000 by default."),
+                                           QStringLiteral("count"), QStringLiteral("2000000"));
+        QCommandLineOption batchOption(QStringLiteral("batch"),
+                                       QStringLiteral("Mutations applied within one event loop iteration, 8 by default."),
+                                       QStringLiteral("count"), QStringLiteral("8"));
+        QCommandLineOption popupOption(QStringLiteral("popup-every"),
+                                       QStringLiteral("Mutations between two popups shown and dismissed, 16 by default."),
+                                       QStringLiteral("count"), QStringLiteral("16"));
+        QCommandLineOption itemsOption(QStringLiteral("items"), QStringLiteral("Most items in the menus, 400 by default."),
+                                       QStringLiteral("count"), QStringLiteral("400"));
+        QCommandLineOption sampleOption(QStringLiteral("sample-every"),
+                                        QStringLiteral("Mutations between two samples of the counts, 50000 by default."),
+                                        QStringLiteral("count"), QStringLiteral("50000"));
+        parser.addOption(seedOption);
+        parser.addOption(mutationsOption);
+        parser.addOption(batchOption);
+        parser.addOption(popupOption);
+        parser.addOption(itemsOption);
+        parser.addOption(sampleOption);
+        parser.process(app);
+
+        const quint32 seed = parser.isSet(seedOption) ? parser.value(seedOption).toUInt()
+                                                      : static_cast<quint32>(QDateTime::currentMSecsSinceEpoch());
+        const int mutations = parser.value(mutationsOption).toInt();
+        const int batch = qMax(parser.value(batchOption).toInt(), 1);
+        const int popupEvery = qMax(parser.value(popupOption).toInt(), 1);
+        const int sampleEvery = qMax(parser.value(sampleOption).toInt(), 1);
+        qInfo("seed %u", seed);
+
+        // The exporter and the monitor have connections of their own
+        GDBusConnection *appConnection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        GDBusConnection *monitor = g_dbus_connection_new_for_address_sync(
+                    g_test_dbus_get_bus_address(bus),
+                    static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+                    nullptr, nullptr, nullptr);
+        if (!appConnection || !monitor) {
+            qFatal("Failed to connect to the test bus");
+        }
+        const gchar *service = g_dbus_connection_get_unique_name(appConnection);
+
+        QMap<QString, QVector<qint64>> samples;
+        {
+            // Outlives the menus registered for it
+            QWindow window;
+            MenuDriver driver(seed);
+            driver.setItemLimit(parser.value(itemsOption).toInt());
+            driver.populate(6);
+            driver.bar()->handleReparent(&window);
+            flush();
+            const QByteArray path = driver.bar()->exportedPath().toUtf8();
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 1; i <= mutations; ++i) {
+                driver.mutate();
+                if (i % popupEvery == 0) {
+                    if (UnityPlatformMenu *menu = driver.randomMenu()) {
+                        menu->showPopup(&window, QRect(), nullptr);
+                        flush();
+                        menu->dismiss();
+                    }
+                }
+                if (i % batch == 0) {
+                    flush();
+                }
+                if (i % sampleEvery == 0) {
+                    flush();
+                    const QMap<QString, qint64> counts = fetchStatistics(monitor, service, path);
+                    if (counts.isEmpty()) {
+                        result = 1;
+                        break;
+                    }
+
+                    QStringList line;
+                    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+                        samples[it.key()].append(it.value());
+                        line.append(QStringLiteral("%1=%2").arg(it.key()).arg(it.value()));
+                    }
+                    qInfo("%d mutations, %d items, %lld ms: %s", i, driver.itemCount(), timer.elapsed(),
+                          qPrintable(line.join(QLatin1Char(' '))));
+                }
+            }
+        }
+
+        // The first sample is taken while the menus still grow to their limit
+        for (auto it = samples.begin(); it != samples.end(); ++it) {
+            QVector<qint64> &keySamples = it.value();
+            if (!keySamples.isEmpty()) keySamples.removeFirst();
+            if (keepsGrowing(it.key(), keySamples)) {
+                qWarning("%s keeps growing, from %lld to %lld, seed %u", qPrintable(it.key()),
+                         keySamples.first(), keySamples.last(), seed);
+                result = 1;
+            }
+        }
+        if (samples.value(QStringLiteral("actions")).count() < 3) {
+            qWarning("Too few samples to tell growth, lower --sample-every");
+        }
+
+        g_dbus_connection_close_sync(monitor, nullptr, nullptr);
+        g_object_unref(monitor);
+        g_object_unref(appConnection);
+    }
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+    return result;
+}
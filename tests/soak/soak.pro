@@ -0,0 +1,17 @@
+TARGET = unity-menu-soak
+TEMPLATE = app
+
+QT += gui
+
+CONFIG += console no_keywords
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++11 -Werror -Wall
+
+include(../../src/unityappmenu/unityappmenu.pri)
+include(../common/common.pri)
+
+INCLUDEPATH += ../menudriver
+
+HEADERS += ../menudriver/menudriver.h
+SOURCES += main.cpp ../menudriver/menudriver.cpp
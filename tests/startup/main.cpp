@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2017 Canonical, Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranties of MERCHANTABILITY,
+ * SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the time from the QGuiApplication construction until the shell could render
+// the first menu: the menubar is registered, and the shell fetched its top level items.
+// A stand-in shell owns the registrar on a private bus, and fetches the registered menus
+// like the unity8 shell does.
+
+#include "eventloop.h"
+#include "gmenumodelplatformmenu.h"
+#include "standinregistrar.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QWindow>
+
+#include <gio/gio.h>
+
+namespace {
+
+// Owns the registrar, and fetches the first menu registered with it like the unity8 shell does
+class StandInShell
+{
+public:
+    StandInShell(const gchar *address, const QElapsedTimer &clock);
+    ~StandInShell();
+
+    // Times since the clock started, -1 until then
+    qint64 registeredAt = -1;
+    qint64 renderedAt = -1;
+
+private:
+    static void itemsChanged(GMenuModel *model, gint position, gint removed, gint added, gpointer user_data);
+    void fetch(const gchar *service, const gchar *path);
+
+    const QElapsedTimer &m_clock;
+    StandInRegistrar m_registrar;
+    GMenuModel *m_menu;
+};
+
+StandInShell::StandInShell(const gchar *address, const QElapsedTimer &clock)
+    : m_clock(clock)
+    , m_registrar(address)
+    , m_menu(nullptr)
+{
+    m_registrar.menuRegistered = [this](const gchar *service, const gchar *path) { fetch(service, path); };
+}
+
+StandInShell::~StandInShell()
+{
+    if (m_menu) {
+        g_signal_handlers_disconnect_by_data(m_menu, this);
+        g_object_unref(m_menu);
+    }
+}
+
+void StandInShell::fetch(const gchar *service, const gchar *path)
+{
+    if (m_menu) return;
+
+    registeredAt = m_clock.elapsed();
+    m_menu = G_MENU_MODEL(g_dbus_menu_model_get(m_registrar.connection(), service, path));
+    g_signal_connect(m_menu, "items-changed", G_CALLBACK(itemsChanged), this);
+    // Subscribes to the menu, its items arrive with items-changed
+    g_menu_model_get_n_items(m_menu);
+}
+
+void StandInShell::itemsChanged(GMenuModel *model, gint, gint, gint, gpointer user_data)
+{
+    auto shell = static_cast<StandInShell*>(user_data);
+    if (shell->renderedAt < 0 && g_menu_model_get_n_items(model) > 0) {
+        shell->renderedAt = shell->m_clock.elapsed();
+    }
+}
+
+UnityPlatformMenu *createMenu(int items)
+{
+    auto menu = new UnityPlatformMenu;
+    for (int i = 0; i < items; ++i) {
+        auto item = new UnityPlatformMenuItem;
+        item->setText(QStringLiteral("Item %1").arg(i));
+        if (i % 5 == 4) {
+            item->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_A + i % 26));
+        }
+        menu->insertMenuItem(item, nullptr);
+    }
+    return menu;
+}
+
+void destroyMenu(UnityPlatformMenu *menu)
+{
+    const QList<QPlatformMenuItem*> items = menu->menuItems();
+    delete menu;
+    qDeleteAll(items);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    // The shell runs before the application starts
+    QElapsedTimer clock;
+    StandInShell *shell = new StandInShell(g_test_dbus_get_bus_address(bus), clock);
+
+    clock.start();
+    int result = 0;
+    {
+        QGuiApplication app(argc, argv);
+        const qint64 constructedAt = clock.elapsed();
+        QCoreApplication::setApplicationName(QStringLiteral("unity-menu-startup-benchmark"));
+
+        QCommandLineParser parser;
+        parser.setApplicationDescription(QStringLiteral("Measures the time from the application construction until "
+                                                        "the shell could render the first menu."));
+        parser.addHelpOption();
+        QCommandLineOption menusOption(QStringLiteral("menus"), QStringLiteral("Number of top level menus, 8 by default."),
+                                       QStringLiteral("count"), QStringLiteral("8"));
+        QCommandLineOption itemsOption(QStringLiteral("items"), QStringLiteral("Items per menu, 20 by default."),
+                                       QStringLiteral("count"), QStringLiteral("20"));
+        QCommandLineOption idleOption(QStringLiteral("idle"),
+                                      QStringLiteral("Time the event loop runs between creating the menus and showing "
+                                                     "the window, in ms, 0 by default."),
+                                      QStringLiteral("ms"), QStringLiteral("0"));
+        parser.addOption(menusOption);
+        parser.addOption(itemsOption);
+        parser.addOption(idleOption);
+        parser.process(app);
+
+        const int idle = parser.value(idleOption).toInt();
+        {
+            UnityPlatformMenuBar bar;
+            const int menus = parser.value(menusOption).toInt();
+            for (int i = 0; i < menus; ++i) {
+                UnityPlatformMenu *menu = createMenu(parser.value(itemsOption).toInt());
+                menu->setText(QStringLiteral("Menu %1").arg(i));
+                bar.insertMenu(menu, nullptr);
+            }
+            const qint64 builtAt = clock.elapsed();
+
+            if (idle > 0) {
+                waitFor([]() { return false; }, idle);
+            }
+
+            // What Qt does when the window of the menubar is created
+            QWindow window;
+            const qint64 shownAt = clock.elapsed();
+            bar.handleReparent(&window);
+            const qint64 reparentedAt = clock.elapsed();
+
+            if (waitFor([shell]() { return shell->renderedAt >= 0; })) {
+                qInfo("application constructed: %lld ms", constructedAt);
+                qInfo("menus created: %lld ms", builtAt);
+                qInfo("window shown: %lld ms, handleReparent took %lld ms", shownAt, reparentedAt - shownAt);
+                qInfo("menu registered: %lld ms", shell->registeredAt);
+                qInfo("first menu rendered: %lld ms", shell->renderedAt);
+            } else {
+                qWarning("The shell didn't get the menu, registered at %lld ms", shell->registeredAt);
+                result = 1;
+            }
+
+            Q_FOREACH(QPlatformMenu *menu, bar.menus()) {
+                bar.removeMenu(menu);
+                destroyMenu(static_cast<UnityPlatformMenu*>(menu));
+            }
+        }
+        delete shell;
+    }
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+    return result;
+}
@@ -0,0 +1,3 @@
+TEMPLATE = subdirs
+
+SUBDIRS += menudriver registrar soak startup